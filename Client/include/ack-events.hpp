@@ -0,0 +1,80 @@
+#ifndef CLIENT_ACK_EVENTS_HPP
+#define CLIENT_ACK_EVENTS_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <sys/types.h>
+#include "reliable-udp.hpp"
+
+#define ACK_BATCH_SIZE 32
+#define ACK_EVENT_SOCKET 0x01
+#define ACK_EVENT_TIMER 0x02
+#define ACK_EVENT_SENDER 0x04
+
+/**
+ * @brief Everything the acknowledgement thread sleeps on: the socket, a timerfd for the next retransmission
+ *        deadline and an eventfd the sender thread can wake it with, all in one epoll set
+ *
+ * Without epoll only the socket is polled and the timer is kept as a deadline to shorten the wait to
+ */
+struct ack_events {
+    int epoll_fd;
+    int timer_fd;
+    int sender_fd;
+    int socket_fd;
+    bool timer_armed;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+/**
+ * @brief Acknowledgements read off the socket in one call
+ */
+struct ack_batch {
+    char buffers[ACK_BATCH_SIZE][MAX_ACK_LENGTH];
+    ssize_t lengths[ACK_BATCH_SIZE];
+    size_t count;
+};
+
+/**
+ * @brief Create the epoll set, the retransmission timerfd and the sender eventfd, and watch the socket
+ * @param events Ack events struct
+ * @param socket_fd Socket acknowledgements arrive on
+ * @return True if successful, false otherwise
+ */
+bool open_ack_events(struct ack_events& events, int socket_fd);
+/**
+ * @brief Close every descriptor opened by open_ack_events
+ * @param events Ack events struct
+ * @return void
+ */
+void close_ack_events(struct ack_events& events);
+/**
+ * @brief Arm the retransmission timer for a deadline, or disarm it, skipping the call when nothing changed
+ * @param events Ack events struct
+ * @param armed Whether any retransmission timer is pending
+ * @param deadline Earliest retransmission deadline, ignored when not armed
+ * @return void
+ */
+void arm_ack_timer(struct ack_events& events, bool armed, std::chrono::steady_clock::time_point deadline);
+/**
+ * @brief Wake the acknowledgement thread, safe to call from the sender thread
+ * @param events Ack events struct
+ * @return void
+ */
+void signal_ack_events(struct ack_events& events);
+/**
+ * @brief Sleep until an acknowledgement arrives, the retransmission timer fires or the sender signals
+ * @param events Ack events struct
+ * @param max_wait Longest time to sleep when nothing happens
+ * @return Mask of ACK_EVENT_ bits that are ready, 0 on timeout or interrupt, -1 on failure
+ */
+int wait_for_ack_events(struct ack_events& events, std::chrono::microseconds max_wait);
+/**
+ * @brief Read every acknowledgement already queued on the socket, up to ACK_BATCH_SIZE, without blocking
+ * @param events Ack events struct
+ * @param batch Filled with the datagrams read
+ * @return Number of datagrams read, -1 on failure
+ */
+ssize_t receive_ack_batch(struct ack_events& events, struct ack_batch& batch);
+
+#endif
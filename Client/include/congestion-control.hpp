@@ -0,0 +1,144 @@
+#ifndef CLIENT_CONGESTION_CONTROL_HPP
+#define CLIENT_CONGESTION_CONTROL_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#define DEFAULT_CONGESTION_CONTROL "reno"
+#define INITIAL_CONGESTION_WINDOW 10
+#define MIN_CONGESTION_WINDOW 2
+#define CUBIC_C 0.4
+#define CUBIC_BETA 0.7
+
+/**
+ * @brief Congestion controller driven by ack and loss events, sizes the congestion window in packets.
+ *        Slow start and loss recovery are shared; algorithms supply the congestion avoidance growth and the decrease.
+ */
+class congestion_controller {
+public:
+    virtual ~congestion_controller() = default;
+
+    /**
+     * @brief Grow the window for newly acknowledged packets
+     * @param acked Number of packets newly acknowledged
+     * @param send_base Oldest sequence number still unacknowledged
+     * @param srtt Smoothed round trip time
+     * @param now Current time
+     * @return void
+     */
+    virtual void on_packets_acked(uint32_t acked, uint32_t send_base, std::chrono::microseconds srtt, std::chrono::steady_clock::time_point now);
+    /**
+     * @brief Shrink the window once per window of data when a packet is found lost
+     * @param sequence_number Sequence number of the lost packet
+     * @param next_sequence_number Sequence number the next new packet will use
+     * @param now Current time
+     * @return void
+     */
+    virtual void on_packet_lost(uint32_t sequence_number, uint32_t next_sequence_number, std::chrono::steady_clock::time_point now);
+    /**
+     * @brief Collapse the window after the retransmission timer of the oldest packet expires
+     * @param sequence_number Sequence number of the oldest packet
+     * @param next_sequence_number Sequence number the next new packet will use
+     * @param now Current time
+     * @return void
+     */
+    virtual void on_retransmission_timeout(uint32_t sequence_number, uint32_t next_sequence_number, std::chrono::steady_clock::time_point now);
+    /**
+     * @brief Get the number of packets allowed in flight
+     * @return Congestion window in packets
+     */
+    uint32_t congestion_window() const;
+    /**
+     * @brief Check whether the window is still growing exponentially
+     * @return True while below the slow start threshold
+     */
+    bool in_slow_start() const;
+    /**
+     * @brief Get the name the algorithm is selected by
+     * @return Algorithm name
+     */
+    virtual const char * name() const = 0;
+
+protected:
+    /**
+     * @brief Congestion avoidance growth
+     * @param acked Number of packets newly acknowledged
+     * @param srtt Smoothed round trip time
+     * @param now Current time
+     * @return void
+     */
+    virtual void increase_window(uint32_t acked, std::chrono::microseconds srtt, std::chrono::steady_clock::time_point now) = 0;
+    /**
+     * @brief Multiplicative decrease applied on loss
+     * @param now Current time
+     * @return New slow start threshold in packets
+     */
+    virtual double reduce_window(std::chrono::steady_clock::time_point now) = 0;
+
+    double cwnd = INITIAL_CONGESTION_WINDOW;
+    double ssthresh = 1e9;
+
+private:
+    bool in_recovery = false;
+    bool loss_seen = false;
+    uint32_t recovery_point = 0;
+};
+
+/**
+ * @brief NewReno style AIMD, one packet per round trip of growth and halving on loss
+ */
+class reno_congestion_controller : public congestion_controller {
+public:
+    const char * name() const override;
+
+protected:
+    void increase_window(uint32_t acked, std::chrono::microseconds srtt, std::chrono::steady_clock::time_point now) override;
+    double reduce_window(std::chrono::steady_clock::time_point now) override;
+};
+
+/**
+ * @brief CUBIC (RFC 9438), window grows as a cubic function of the time since the last loss
+ */
+class cubic_congestion_controller : public congestion_controller {
+public:
+    const char * name() const override;
+
+protected:
+    void increase_window(uint32_t acked, std::chrono::microseconds srtt, std::chrono::steady_clock::time_point now) override;
+    double reduce_window(std::chrono::steady_clock::time_point now) override;
+
+private:
+    double w_max = 0;
+    double w_est = 0;
+    double k = 0;
+    double origin = 0;
+    bool epoch_started = false;
+    std::chrono::steady_clock::time_point epoch_start;
+};
+
+/**
+ * @brief No congestion control, only the send and receiver windows limit the sender
+ */
+class fixed_congestion_controller : public congestion_controller {
+public:
+    fixed_congestion_controller();
+    void on_packets_acked(uint32_t acked, uint32_t send_base, std::chrono::microseconds srtt, std::chrono::steady_clock::time_point now) override;
+    void on_packet_lost(uint32_t sequence_number, uint32_t next_sequence_number, std::chrono::steady_clock::time_point now) override;
+    void on_retransmission_timeout(uint32_t sequence_number, uint32_t next_sequence_number, std::chrono::steady_clock::time_point now) override;
+    const char * name() const override;
+
+protected:
+    void increase_window(uint32_t acked, std::chrono::microseconds srtt, std::chrono::steady_clock::time_point now) override;
+    double reduce_window(std::chrono::steady_clock::time_point now) override;
+};
+
+/**
+ * @brief Create a congestion controller by name
+ * @param name One of "reno", "cubic" or "none"
+ * @return Congestion controller, nullptr if the name is unknown
+ */
+std::unique_ptr<congestion_controller> make_congestion_controller(const std::string& name);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef CLIENT_FEC_HPP
+#define CLIENT_FEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include "reliable-udp.hpp"
+#include "send-batch.hpp"
+
+#define MAX_FEC_GROUP 64
+#define MAX_FEC_PARITY 8
+#define FEC_PARITY_SLOTS (2 * SEND_BATCH_SIZE)
+
+/**
+ * @brief Running XOR parity over groups of group_size data packets, parity_count packets per group
+ *
+ * Parity j covers every member i of the group with i % parity_count == j, so any run of up to parity_count
+ * consecutive losses in a group costs each parity at most one packet and the receiver rebuilds them all.
+ * Groups are aligned to sequence numbers, the receiver maps a data packet to its group without waiting for the parity.
+ */
+struct fec_encoder {
+    uint32_t group_size;
+    uint32_t parity_count;
+    size_t payload_length;
+    size_t words;
+    uint32_t group;
+    uint32_t members;
+    std::vector<uint64_t> parity;
+    uint16_t length_parity[MAX_FEC_PARITY];
+    std::vector<char> slots;
+    size_t next_slot;
+};
+
+/**
+ * @brief Size the parity rows and the ring parity datagrams are built in
+ * @param encoder FEC encoder struct
+ * @param group_size Data packets per group, 0 disables parity
+ * @param parity_count Parity packets per group
+ * @param payload_length Largest payload, every parity packet carries this many bytes
+ * @return True if successful, false if the memory could not be allocated
+ */
+bool init_fec_encoder(struct fec_encoder& encoder, uint32_t group_size, uint32_t parity_count, size_t payload_length);
+/**
+ * @brief Fold a newly sent data packet into its parity row
+ * @param encoder FEC encoder struct
+ * @param sequence_number Sequence number of the packet
+ * @param payload Payload as sent
+ * @param data_length Data length field of its header, folded in so the receiver recovers the exact length
+ * @return True once the packet completes its group
+ */
+bool fec_add_packet(struct fec_encoder& encoder, uint32_t sequence_number, std::string_view payload, uint16_t data_length);
+/**
+ * @brief Build one parity datagram of the group so far, header and payload, into the next slot of the ring
+ *
+ * A slot is only reused after FEC_PARITY_SLOTS more parity packets, by which time any send batch that
+ * referenced it has been flushed
+ *
+ * @param encoder FEC encoder struct
+ * @param index Which parity of the group, below parity_count
+ * @return Header and payload, the caller adds the trailer
+ */
+std::string_view fec_build_parity(struct fec_encoder& encoder, uint32_t index);
+/**
+ * @brief Clear the parity rows for the next group once every parity of this one is built
+ * @param encoder FEC encoder struct
+ * @return void
+ */
+void fec_next_group(struct fec_encoder& encoder);
+
+#endif
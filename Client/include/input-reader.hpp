@@ -0,0 +1,60 @@
+#ifndef CLIENT_INPUT_READER_HPP
+#define CLIENT_INPUT_READER_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define INPUT_BUFFER_SIZE (256 * 1024)
+
+/**
+ * @brief Source of file transfer payloads, either a mapped file or a descriptor read in large blocks
+ */
+struct input_reader {
+    int fd = -1;
+    const char * mapped = nullptr;
+    size_t mapped_length = 0;
+    size_t offset = 0;
+    std::vector<char> buffer;
+    size_t start = 0;
+    size_t end = 0;
+    bool eof = false;
+};
+
+/**
+ * @brief Map a named file, falling back to block reads when it cannot be mapped
+ * @param reader Input reader struct
+ * @param path Path of the file to send
+ * @return True if successful, false otherwise
+ */
+bool open_input_file(struct input_reader& reader, const std::string& path);
+/**
+ * @brief Read an already open descriptor in large blocks
+ * @param reader Input reader struct
+ * @param fd Descriptor to read from
+ * @return void
+ */
+void open_input_stream(struct input_reader& reader, int fd);
+/**
+ * @brief Slice the next payload out of the input
+ * @param reader Input reader struct
+ * @param max_length Largest payload
+ * @return Payload, valid until the next call, empty once the input is exhausted
+ */
+std::string_view next_payload(struct input_reader& reader, size_t max_length);
+/**
+ * @brief Check whether the next payload can be taken without waiting on the input
+ * @param reader Input reader struct
+ * @param max_length Largest payload
+ * @return True if a full payload is buffered or more input is readable right now
+ */
+bool input_pending(const struct input_reader& reader, size_t max_length);
+/**
+ * @brief Unmap or close the input
+ * @param reader Input reader struct
+ * @return void
+ */
+void close_input(struct input_reader& reader);
+
+#endif
@@ -4,9 +4,9 @@
 
 #include <netinet/in.h>
 #include <string>
+#include <string_view>
 #include <ctime>
-
-#define DEFAULT_PORT 5050
+#include <chrono>
 
 /**
  * @brief Networking options struct
@@ -19,14 +19,28 @@ struct networking_options {
     struct sockaddr_in ipv4_addr;
     struct sockaddr_in6 ipv6_addr;
     struct header_field * header;
+    struct input_reader * input;
+    std::string input_file;
+    bool stable_input;
     std::string device_ip_address;
     std::string receiver_ip_address;
     in_port_t receiver_port;
     bool terminal_input;
+    uint32_t link_mtu;
+    size_t payload_length;
+    uint32_t fec_group_size;
+    uint32_t fec_parity_count;
     time_t time_started;
     size_t current_window_size;
+    size_t packets_in_flight;
+    uint32_t send_window_size;
+    uint32_t receiver_window_size;
+    std::string congestion_algorithm;
+    bool pacing;
+    double pacing_rate;
     pid_t parent_pid;
-    FILE * stats_file;
+    struct stats_writer * stats;
+    bool binary_stats;
 };
 
 /**
@@ -37,8 +51,9 @@ struct header_field {
     uint32_t ack_number;
     uint8_t flags;
     uint16_t data_length;
-    std::string data;
-    uint64_t sent_counter;
+    std::string_view data;
+    std::chrono::steady_clock::time_point sent_time;
+    uint32_t transmissions;
 };
 
 /**
@@ -0,0 +1,60 @@
+#ifndef CLIENT_PACING_HPP
+#define CLIENT_PACING_HPP
+
+#include <chrono>
+#include <cstddef>
+
+#define PACING_BURST_PACKETS 4
+#define PACING_SLOW_START_GAIN 2.0
+#define PACING_CONGESTION_AVOIDANCE_GAIN 1.25
+
+/**
+ * @brief Token bucket that spreads packets out at a set rate while allowing short bounded bursts
+ */
+struct pacer {
+    double rate;
+    double tokens;
+    double bucket_size;
+    std::chrono::steady_clock::time_point last_refill;
+};
+
+/**
+ * @brief Set up a pacer
+ * @param pacer Pacer struct
+ * @param bytes_per_second Sending rate, 0 to leave sending unpaced until a rate is set
+ * @param bucket_size Largest burst in bytes
+ * @return void
+ */
+void pacer_init(struct pacer& pacer, double bytes_per_second, double bucket_size);
+/**
+ * @brief Change the pacing rate, crediting tokens earned at the old rate first
+ * @param pacer Pacer struct
+ * @param bytes_per_second New sending rate
+ * @param now Current time
+ * @return void
+ */
+void pacer_set_rate(struct pacer& pacer, double bytes_per_second, std::chrono::steady_clock::time_point now);
+/**
+ * @brief Find when a packet may leave
+ * @param pacer Pacer struct
+ * @param bytes Size of the packet
+ * @param now Current time
+ * @return Time at which enough tokens will have accumulated, now if they already have
+ */
+std::chrono::steady_clock::time_point pacer_release_time(struct pacer& pacer, size_t bytes, std::chrono::steady_clock::time_point now);
+/**
+ * @brief Take the tokens for a packet that was sent
+ * @param pacer Pacer struct
+ * @param bytes Size of the packet
+ * @param now Current time
+ * @return void
+ */
+void pacer_consume(struct pacer& pacer, size_t bytes, std::chrono::steady_clock::time_point now);
+/**
+ * @brief Sleep on the monotonic clock until an absolute time
+ * @param release Time to wake up at
+ * @return void
+ */
+void pacer_sleep_until(std::chrono::steady_clock::time_point release);
+
+#endif
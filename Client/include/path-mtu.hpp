@@ -0,0 +1,32 @@
+#ifndef CLIENT_PATH_MTU_HPP
+#define CLIENT_PATH_MTU_HPP
+
+#include <cstddef>
+#include "reliable-udp.hpp"
+
+#define DEFAULT_LINK_MTU 0
+#define IPV4_UDP_OVERHEAD 28
+#define IPV6_UDP_OVERHEAD 48
+#define BASE_DATAGRAM_LENGTH (FIXED_HEADER_LENGTH + MAX_PACKET_LENGTH + 3)
+#define MAX_DATAGRAM_LENGTH 9216
+#define PROBE_CANDIDATES 8
+#define PROBE_MAX_ROUNDS 3
+#define PROBE_TIMEOUT_MS 1000
+#define PROBE_GRANULARITY 16
+#define PROBE_CONFIRM_TRIES 10
+
+/**
+ * @brief Search for the largest datagram the path and the receiver both carry, then settle the payload size with the receiver
+ *
+ * Packetization layer path MTU discovery in the style of RFC 8899: padded probes go out with the don't fragment bit set,
+ * a round at a time spread across the sizes still in doubt, and the largest one acknowledged becomes the new floor.
+ * The base size is assumed to work, so a receiver that never answers leaves the payload at MAX_PACKET_LENGTH.
+ * The search runs once before any data is sent, the size then stays fixed for the transfer.
+ * It only runs when a link MTU is given, otherwise the payload stays at MAX_PACKET_LENGTH without a single probe.
+ *
+ * @param networkingOptions Networking options struct, payload_length is set
+ * @return True if successful, false if the receiver answered probes but never confirmed the size
+ */
+bool negotiate_payload_length(struct networking_options& networkingOptions);
+
+#endif
@@ -3,22 +3,79 @@
 
 #include <cstdint>
 
-#define WINDOW_SIZE 4
+#define DEFAULT_WINDOW_SIZE 5
+#define MAX_WINDOW_SIZE 65536
 #define HEADER_LENGTH 13
+#define FIXED_HEADER_LENGTH 11
+#define ACK_LENGTH 17
+#define SACK_MAX_BLOCKS 8
+#define MAX_ACK_LENGTH (ACK_LENGTH + 5 + SACK_MAX_BLOCKS * 8)
+#define ACK_FLAG 0x01
+#define SACK_FLAG 0x02
+#define PROBE_FLAG 0x04
+#define FEC_FLAG 0x08
 #define MAX_PACKET_LENGTH 1010
-#define RETRANSMISSION_COUNT 30
+#define WINDOW_WAIT_MS 100
+#define FAST_RETRANSMIT_THRESHOLD 3
+#define TAIL_PROBE_MIN_MS 10
 
 /**
- * @brief Send a packet to the receiver
+ * @brief Allocate the ring of in-flight packets for the configured send window and create the congestion controller and pacer
  * @param networkingOptions Networking options struct
- * @return 1 if window size exceeded, -1 if send failed, 0 otherwise
+ * @return True if successful, false otherwise
+ */
+bool init_send_window(struct networking_options& networkingOptions);
+/**
+ * @brief Queue a packet for the receiver, sending the queued batch once it fills or the packet is held back
+ * @param networkingOptions Networking options struct
+ * @return 1 if window size exceeded, 2 if held back by the pacer, -1 if send failed, 0 otherwise
  */
 int send_packet(struct networking_options& networkingOptions);
 /**
- * @brief Send a packet to the receiver
+ * @brief Send every queued packet to the receiver
+ * @param networkingOptions Networking options struct
+ * @return -1 if send failed, 0 otherwise
+ */
+int flush_packets(struct networking_options& networkingOptions);
+/**
+ * @brief Send the parity of a group the input ended partway through, so the last packets are covered too
+ * @param networkingOptions Networking options struct
+ * @return 0 if successful, -1 otherwise
+ */
+int flush_parity(struct networking_options& networkingOptions);
+/**
+ * @brief Sleep until the pacer will let the current packet leave
+ * @param networkingOptions Networking options struct
+ * @return void
+ */
+void wait_for_pacer(struct networking_options& networkingOptions);
+/**
+ * @brief Sleep until an acknowledgement frees window space for the current packet
+ * @param networkingOptions Networking options struct
+ * @return void
+ */
+void wait_for_window(struct networking_options& networkingOptions);
+/**
+ * @brief Set up the epoll set the acknowledgement thread waits on, once the socket exists
+ * @param networkingOptions Networking options struct
+ * @return True if successful, false otherwise
+ */
+bool init_ack_receiver(struct networking_options& networkingOptions);
+/**
+ * @brief Count the packets sent and not yet acknowledged, as of now rather than the last acknowledgement pass
+ * @return Number of packets outstanding
+ */
+uint32_t packets_outstanding();
+/**
+ * @brief Wake the acknowledgement thread whether or not it sleeps, so a change it polls for, like the end of the input, is seen at once
+ * @return void
+ */
+void wake_ack_receiver();
+/**
+ * @brief Wait for acknowledgements, the retransmission timer or new packets, then handle every acknowledgement queued
  * @param networkingOptions Networking options struct
- * @param timeout_seconds Microseconds to wait for select
- * @return Acknowledgement number if successful, 0 otherwise
+ * @param timeout_seconds Longest time in microseconds to wait when nothing happens at all
+ * @return Last acknowledgement number handled, 1 if none arrived, 0 on failure
  */
 uint32_t receive_acknowledgements(struct networking_options& networkingOptions, int timeout_seconds);
 
@@ -0,0 +1,44 @@
+#ifndef CLIENT_RTT_ESTIMATOR_HPP
+#define CLIENT_RTT_ESTIMATOR_HPP
+
+#include <chrono>
+#include <cstdint>
+
+#define INITIAL_RTO_MS 1000
+#define MIN_RTO_MS 200
+#define MAX_RTO_MS 60000
+#define MAX_RTO_BACKOFF 6
+#define CLOCK_GRANULARITY_US 1000
+
+/**
+ * @brief Smoothed round trip time state used to derive the retransmission timeout (RFC 6298)
+ */
+struct rtt_estimator {
+    std::chrono::microseconds srtt{0};
+    std::chrono::microseconds rttvar{0};
+    std::chrono::microseconds rto{std::chrono::milliseconds(INITIAL_RTO_MS)};
+    uint32_t backoff = 0;
+    bool has_sample = false;
+};
+
+/**
+ * @brief Feed a round trip time measurement into the estimator
+ * @param estimator RTT estimator struct
+ * @param sample Measured round trip time of a packet that was only sent once
+ * @return void
+ */
+void rtt_add_sample(struct rtt_estimator& estimator, std::chrono::microseconds sample);
+/**
+ * @brief Double the retransmission timeout after a timer expiry
+ * @param estimator RTT estimator struct
+ * @return void
+ */
+void rtt_backoff(struct rtt_estimator& estimator);
+/**
+ * @brief Get the retransmission timeout including any exponential backoff
+ * @param estimator RTT estimator struct
+ * @return Current retransmission timeout
+ */
+std::chrono::microseconds rtt_current_rto(const struct rtt_estimator& estimator);
+
+#endif
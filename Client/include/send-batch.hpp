@@ -0,0 +1,48 @@
+#ifndef CLIENT_SEND_BATCH_HPP
+#define CLIENT_SEND_BATCH_HPP
+
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <cstddef>
+
+#define SEND_BATCH_SIZE 32
+#define SEND_BATCH_PARTS 3
+
+/**
+ * @brief Datagrams waiting to be handed to the kernel in one call, each gathered from up to SEND_BATCH_PARTS buffers
+ */
+struct send_batch {
+    struct iovec parts[SEND_BATCH_SIZE * SEND_BATCH_PARTS];
+    size_t part_counts[SEND_BATCH_SIZE];
+    size_t lengths[SEND_BATCH_SIZE];
+    size_t part_total;
+    size_t count;
+};
+
+/**
+ * @brief Check whether another datagram fits in the batch
+ * @param batch Send batch struct
+ * @return True if the batch is full
+ */
+bool send_batch_full(const struct send_batch& batch);
+/**
+ * @brief Add a datagram to the batch, the buffers are referenced rather than copied and must outlive the flush
+ * @param batch Send batch struct
+ * @param parts Buffers making up the datagram, in order
+ * @param part_count Number of buffers, at most SEND_BATCH_PARTS
+ * @return void
+ */
+void send_batch_add(struct send_batch& batch, const struct iovec * parts, size_t part_count);
+/**
+ * @brief Send every datagram in the batch, as one UDP_SEGMENT buffer when the sizes allow it,
+ *        otherwise with sendmmsg, otherwise one sendmsg each. The batch is empty afterwards.
+ * @param batch Send batch struct
+ * @param socket_fd Socket to send on
+ * @param destination Receiver address
+ * @param destination_length Size of the receiver address
+ * @return Number of datagrams sent, -1 if the first one could not be sent
+ */
+ssize_t send_batch_flush(struct send_batch& batch, int socket_fd, const struct sockaddr * destination, socklen_t destination_length);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef CLIENT_STATS_WRITER_HPP
+#define CLIENT_STATS_WRITER_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STATS_RING_SIZE 65536
+#define STATS_RECORD_LENGTH 12
+#define STATS_WRITE_BUFFER_SIZE 65536
+#define STATS_IDLE_MS 10
+
+/**
+ * @brief One acknowledgement timing sample
+ */
+struct stats_record {
+    uint32_t sequence_number;
+    int64_t time_taken;
+};
+
+/**
+ * @brief Single producer ring of stats records drained to a file in batches by a background thread
+ */
+struct stats_writer {
+    int fd;
+    bool binary;
+    std::vector<stats_record> records;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<size_t> dropped;
+    std::atomic<bool> running;
+    std::thread thread;
+};
+
+/**
+ * @brief Create the stats file, CSV lines the graphing program reads or packed binary records
+ * @param writer Stats writer struct
+ * @param path File to write to
+ * @param binary True for little endian sequence number (4 bytes) then seconds (8 bytes) records
+ * @return True if successful, false otherwise
+ */
+bool open_stats_writer(struct stats_writer& writer, const std::string& path, bool binary);
+/**
+ * @brief Start the thread that writes queued records
+ * @param writer Stats writer struct
+ * @return void
+ */
+void start_stats_writer(struct stats_writer& writer);
+/**
+ * @brief Queue a record without blocking, it is dropped if the writer has fallen a whole ring behind
+ * @param writer Stats writer struct
+ * @param sequence_number Sequence number of the packet
+ * @param time_taken Seconds since the transfer started
+ * @return void
+ */
+void record_stats(struct stats_writer& writer, uint32_t sequence_number, time_t time_taken);
+/**
+ * @brief Write whatever is still queued, stop the thread and close the file
+ * @param writer Stats writer struct
+ * @return void
+ */
+void close_stats_writer(struct stats_writer& writer);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef CLIENT_TIMER_WHEEL_HPP
+#define CLIENT_TIMER_WHEEL_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#define TIMER_WHEEL_TICK_US 1000
+#define TIMER_WHEEL_LEVELS 3
+#define TIMER_WHEEL_LEVEL_BITS 8
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+/**
+ * @brief Intrusive timer entry, embedded in whatever owns the deadline
+ */
+struct timer_node {
+    struct timer_node * next;
+    struct timer_node ** pprev;
+    uint64_t expires;
+    uint32_t sequence_number;
+    uint8_t level;
+    uint8_t slot;
+    bool armed;
+};
+
+/**
+ * @brief Hierarchical timer wheel with 1 ms ticks over three levels of 256 slots (about 4.6 hours of range)
+ */
+struct timer_wheel {
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+    uint64_t current_tick;
+    size_t count;
+    struct timer_node * slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+    uint64_t occupied[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS / 64];
+};
+
+/**
+ * @brief Arm a timer, replacing any deadline it already had
+ * @param wheel Timer wheel struct
+ * @param node Timer to arm
+ * @param deadline Time at which the timer should fire
+ * @return void
+ */
+void timer_wheel_schedule(struct timer_wheel& wheel, struct timer_node& node, std::chrono::steady_clock::time_point deadline);
+/**
+ * @brief Disarm a timer if it is armed
+ * @param wheel Timer wheel struct
+ * @param node Timer to disarm
+ * @return void
+ */
+void timer_wheel_cancel(struct timer_wheel& wheel, struct timer_node& node);
+/**
+ * @brief Advance the wheel to the given time and collect every timer that fired
+ * @param wheel Timer wheel struct
+ * @param now Current time
+ * @return Singly linked list (through next) of expired timers, nullptr if none
+ */
+struct timer_node * timer_wheel_expire(struct timer_wheel& wheel, std::chrono::steady_clock::time_point now);
+/**
+ * @brief Find the earliest armed deadline
+ * @param wheel Timer wheel struct
+ * @param deadline Set to the earliest deadline when one exists
+ * @return True if a timer is armed, false otherwise
+ */
+bool timer_wheel_next_deadline(const struct timer_wheel& wheel, std::chrono::steady_clock::time_point& deadline);
+
+#endif
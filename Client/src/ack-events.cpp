@@ -0,0 +1,209 @@
+#include "ack-events.hpp"
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <algorithm>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#endif
+
+/**
+ * @brief Read a timerfd or eventfd so it stops reporting ready
+ * @param fd Descriptor to drain
+ * @return void
+ */
+static void drain_event_fd(int fd);
+/**
+ * @brief Convert a wait to whole milliseconds, rounding up so a deadline is never woken for early
+ * @param wait Time to wait
+ * @return Milliseconds to wait
+ */
+static int wait_milliseconds(std::chrono::microseconds wait);
+
+static void drain_event_fd(int fd) {
+    uint64_t count;
+
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+        perror("Event read failed");
+    }
+}
+
+static int wait_milliseconds(std::chrono::microseconds wait) {
+    auto milliseconds = std::chrono::ceil<std::chrono::milliseconds>(std::max(wait, std::chrono::microseconds(0)));
+
+    return static_cast<int>(milliseconds.count());
+}
+
+bool open_ack_events(struct ack_events& events, int socket_fd) {
+    events.epoll_fd = -1;
+    events.timer_fd = -1;
+    events.sender_fd = -1;
+    events.socket_fd = socket_fd;
+    events.timer_armed = false;
+
+#ifdef __linux__
+    events.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    events.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    events.sender_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+    if (events.epoll_fd == -1 || events.timer_fd == -1 || events.sender_fd == -1) {
+        close_ack_events(events);
+        return false;
+    }
+
+    // Tag each descriptor with the bit it reports
+    const int watched[3][2] = {
+        {socket_fd, ACK_EVENT_SOCKET},
+        {events.timer_fd, ACK_EVENT_TIMER},
+        {events.sender_fd, ACK_EVENT_SENDER},
+    };
+
+    for (const auto& entry : watched) {
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u32 = static_cast<uint32_t>(entry[1]);
+
+        if (epoll_ctl(events.epoll_fd, EPOLL_CTL_ADD, entry[0], &event) == -1) {
+            close_ack_events(events);
+            return false;
+        }
+    }
+#endif
+
+    return true;
+}
+
+void close_ack_events(struct ack_events& events) {
+    for (int * fd : {&events.epoll_fd, &events.timer_fd, &events.sender_fd}) {
+        if (*fd != -1) {
+            close(*fd);
+            *fd = -1;
+        }
+    }
+}
+
+void arm_ack_timer(struct ack_events& events, bool armed, std::chrono::steady_clock::time_point deadline) {
+    // Most passes find the same oldest packet at the front, so its deadline is already set
+    if (armed == events.timer_armed && (!armed || deadline == events.deadline)) {
+        return;
+    }
+
+    events.timer_armed = armed;
+    events.deadline = deadline;
+
+#ifdef __linux__
+    // The steady clock is CLOCK_MONOTONIC, so the deadline can be handed over as an absolute time
+    struct itimerspec setting{};
+    if (armed) {
+        auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count();
+        // A zero value would disarm it, and a deadline already passed should fire at once
+        since_epoch = std::max<int64_t>(since_epoch, 1);
+        setting.it_value.tv_sec = static_cast<time_t>(since_epoch / 1000000000);
+        setting.it_value.tv_nsec = static_cast<long>(since_epoch % 1000000000);
+    }
+
+    if (timerfd_settime(events.timer_fd, TFD_TIMER_ABSTIME, &setting, nullptr) == -1) {
+        perror("Retransmission timer failed");
+    }
+#endif
+}
+
+void signal_ack_events(struct ack_events& events) {
+    if (events.sender_fd == -1) {
+        return;
+    }
+
+    uint64_t signal = 1;
+    if (write(events.sender_fd, &signal, sizeof(signal)) < 0) {
+        perror("Sender eventfd write failed");
+    }
+}
+
+int wait_for_ack_events(struct ack_events& events, std::chrono::microseconds max_wait) {
+    int ready = 0;
+
+#ifdef __linux__
+    struct epoll_event triggered[3];
+    int count = epoll_wait(events.epoll_fd, triggered, 3, wait_milliseconds(max_wait));
+
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for (int i = 0; i < count; ++i) {
+        auto event = static_cast<int>(triggered[i].data.u32);
+
+        // Level triggered, so the counters are cleared here or the next wait returns at once
+        if (event == ACK_EVENT_TIMER) {
+            drain_event_fd(events.timer_fd);
+        } else if (event == ACK_EVENT_SENDER) {
+            drain_event_fd(events.sender_fd);
+        }
+        ready |= event;
+    }
+#else
+    // No timerfd, so sleep no longer than the deadline it would have fired at
+    if (events.timer_armed) {
+        auto until_deadline = std::chrono::duration_cast<std::chrono::microseconds>(events.deadline - std::chrono::steady_clock::now());
+        max_wait = std::min(until_deadline, max_wait);
+    }
+
+    struct pollfd socket_event{};
+    socket_event.fd = events.socket_fd;
+    socket_event.events = POLLIN;
+
+    int count = poll(&socket_event, 1, wait_milliseconds(max_wait));
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    if (count > 0) {
+        ready |= ACK_EVENT_SOCKET;
+    }
+#endif
+
+    return ready;
+}
+
+ssize_t receive_ack_batch(struct ack_events& events, struct ack_batch& batch) {
+    batch.count = 0;
+
+#ifdef __linux__
+    struct mmsghdr messages[ACK_BATCH_SIZE] = {};
+    struct iovec buffers[ACK_BATCH_SIZE];
+
+    for (size_t i = 0; i < ACK_BATCH_SIZE; ++i) {
+        buffers[i].iov_base = batch.buffers[i];
+        buffers[i].iov_len = MAX_ACK_LENGTH;
+        messages[i].msg_hdr.msg_iov = &buffers[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int received = recvmmsg(events.socket_fd, messages, ACK_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+    }
+
+    for (int i = 0; i < received; ++i) {
+        batch.lengths[i] = static_cast<ssize_t>(messages[i].msg_len);
+    }
+    batch.count = static_cast<size_t>(received);
+#else
+    while (batch.count < ACK_BATCH_SIZE) {
+        ssize_t length = recv(events.socket_fd, batch.buffers[batch.count], MAX_ACK_LENGTH, MSG_DONTWAIT);
+
+        if (length < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return batch.count == 0 ? -1 : static_cast<ssize_t>(batch.count);
+        }
+        batch.lengths[batch.count++] = length;
+    }
+#endif
+
+    return static_cast<ssize_t>(batch.count);
+}
@@ -0,0 +1,170 @@
+#include "congestion-control.hpp"
+#include <algorithm>
+#include <cmath>
+
+void congestion_controller::on_packets_acked(uint32_t acked, uint32_t send_base, std::chrono::microseconds srtt, std::chrono::steady_clock::time_point now) {
+    if (acked == 0) {
+        return;
+    }
+
+    // Recovery ends once everything outstanding at the time of the loss has been acknowledged
+    if (in_recovery && static_cast<int32_t>(send_base - recovery_point) >= 0) {
+        in_recovery = false;
+    }
+
+    if (in_recovery) {
+        return;
+    }
+
+    // Slow start up to the threshold, then hand the remainder to congestion avoidance
+    if (cwnd < ssthresh) {
+        double room = ssthresh - cwnd;
+        if (acked <= room) {
+            cwnd += acked;
+            return;
+        }
+        acked -= static_cast<uint32_t>(room);
+        cwnd = ssthresh;
+    }
+
+    increase_window(acked, srtt, now);
+}
+
+void congestion_controller::on_packet_lost(uint32_t sequence_number, uint32_t next_sequence_number, std::chrono::steady_clock::time_point now) {
+    // Losses from the window already reacted to do not reduce it again
+    if (loss_seen && static_cast<int32_t>(sequence_number - recovery_point) < 0) {
+        return;
+    }
+
+    ssthresh = std::max(reduce_window(now), static_cast<double>(MIN_CONGESTION_WINDOW));
+    cwnd = ssthresh;
+    in_recovery = true;
+    loss_seen = true;
+    recovery_point = next_sequence_number;
+}
+
+void congestion_controller::on_retransmission_timeout(uint32_t sequence_number, uint32_t next_sequence_number, std::chrono::steady_clock::time_point now) {
+    // Only reduce the threshold if this window has not already been reacted to, but always restart from one packet
+    if (!loss_seen || static_cast<int32_t>(sequence_number - recovery_point) >= 0) {
+        ssthresh = std::max(reduce_window(now), static_cast<double>(MIN_CONGESTION_WINDOW));
+    }
+
+    cwnd = 1;
+    in_recovery = false;
+    loss_seen = true;
+    recovery_point = next_sequence_number;
+}
+
+uint32_t congestion_controller::congestion_window() const {
+    return static_cast<uint32_t>(std::max(cwnd, 1.0));
+}
+
+bool congestion_controller::in_slow_start() const {
+    return cwnd < ssthresh;
+}
+
+const char * reno_congestion_controller::name() const {
+    return "reno";
+}
+
+void reno_congestion_controller::increase_window(uint32_t acked, [[maybe_unused]] std::chrono::microseconds srtt,
+                                                 [[maybe_unused]] std::chrono::steady_clock::time_point now) {
+    // Additive increase, about one packet per round trip
+    cwnd += static_cast<double>(acked) / cwnd;
+}
+
+double reno_congestion_controller::reduce_window([[maybe_unused]] std::chrono::steady_clock::time_point now) {
+    // Multiplicative decrease
+    return cwnd / 2;
+}
+
+const char * cubic_congestion_controller::name() const {
+    return "cubic";
+}
+
+void cubic_congestion_controller::increase_window(uint32_t acked, std::chrono::microseconds srtt, std::chrono::steady_clock::time_point now) {
+    if (!epoch_started) {
+        // First growth since the last loss starts a new epoch
+        epoch_started = true;
+        epoch_start = now;
+        w_est = cwnd;
+        if (cwnd < w_max) {
+            k = std::cbrt((w_max - cwnd) / CUBIC_C);
+            origin = w_max;
+        } else {
+            k = 0;
+            origin = cwnd;
+        }
+    }
+
+    // Target one round trip ahead on the cubic curve
+    double t = std::chrono::duration<double>(now - epoch_start + srtt).count();
+    double target = origin + CUBIC_C * std::pow(t - k, 3);
+    target = std::clamp(target, cwnd, 1.5 * cwnd);
+
+    // Reno-friendly estimate so CUBIC is never slower than AIMD on short round trips
+    w_est += 3 * (1 - CUBIC_BETA) / (1 + CUBIC_BETA) * acked / cwnd;
+
+    if (w_est > target) {
+        cwnd = w_est;
+    } else if (target > cwnd) {
+        cwnd += (target - cwnd) * acked / cwnd;
+    } else {
+        cwnd += 0.01 * acked / cwnd;
+    }
+}
+
+double cubic_congestion_controller::reduce_window([[maybe_unused]] std::chrono::steady_clock::time_point now) {
+    // Fast convergence: release bandwidth sooner when the window stopped short of the previous maximum
+    if (cwnd < w_max) {
+        w_max = cwnd * (1 + CUBIC_BETA) / 2;
+    } else {
+        w_max = cwnd;
+    }
+
+    epoch_started = false;
+    return cwnd * CUBIC_BETA;
+}
+
+fixed_congestion_controller::fixed_congestion_controller() {
+    cwnd = UINT32_MAX;
+    ssthresh = UINT32_MAX;
+}
+
+void fixed_congestion_controller::on_packets_acked([[maybe_unused]] uint32_t acked, [[maybe_unused]] uint32_t send_base,
+                                                   [[maybe_unused]] std::chrono::microseconds srtt,
+                                                   [[maybe_unused]] std::chrono::steady_clock::time_point now) {
+}
+
+void fixed_congestion_controller::on_packet_lost([[maybe_unused]] uint32_t sequence_number, [[maybe_unused]] uint32_t next_sequence_number,
+                                                 [[maybe_unused]] std::chrono::steady_clock::time_point now) {
+}
+
+void fixed_congestion_controller::on_retransmission_timeout([[maybe_unused]] uint32_t sequence_number, [[maybe_unused]] uint32_t next_sequence_number,
+                                                            [[maybe_unused]] std::chrono::steady_clock::time_point now) {
+}
+
+const char * fixed_congestion_controller::name() const {
+    return "none";
+}
+
+void fixed_congestion_controller::increase_window([[maybe_unused]] uint32_t acked, [[maybe_unused]] std::chrono::microseconds srtt,
+                                                  [[maybe_unused]] std::chrono::steady_clock::time_point now) {
+}
+
+double fixed_congestion_controller::reduce_window([[maybe_unused]] std::chrono::steady_clock::time_point now) {
+    return cwnd;
+}
+
+std::unique_ptr<congestion_controller> make_congestion_controller(const std::string& name) {
+    if (name == "reno") {
+        return std::make_unique<reno_congestion_controller>();
+    }
+    if (name == "cubic") {
+        return std::make_unique<cubic_congestion_controller>();
+    }
+    if (name == "none") {
+        return std::make_unique<fixed_congestion_controller>();
+    }
+    return nullptr;
+}
@@ -0,0 +1,101 @@
+#include "fec.hpp"
+#include <netinet/in.h>
+#include <cstring>
+#include <new>
+#include <algorithm>
+
+/**
+ * @brief XOR bytes into a parity row a word at a time, the row never aliases the payload so compilers widen it to vector XORs
+ * @param row Parity row
+ * @param data Bytes to fold in
+ * @param length Number of bytes, at most the row's length in bytes
+ * @return void
+ */
+static void xor_into(uint64_t * __restrict row, const char * __restrict data, size_t length);
+
+static void xor_into(uint64_t * __restrict row, const char * __restrict data, size_t length) {
+    size_t words = length / sizeof(uint64_t);
+
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t word;
+        std::memcpy(&word, &data[i * sizeof(uint64_t)], sizeof(word));
+        row[i] ^= word;
+    }
+
+    // The ragged end of a short payload, as if zero padded
+    size_t rest = length - words * sizeof(uint64_t);
+    if (rest > 0) {
+        uint64_t word = 0;
+        std::memcpy(&word, &data[words * sizeof(uint64_t)], rest);
+        row[words] ^= word;
+    }
+}
+
+bool init_fec_encoder(struct fec_encoder& encoder, uint32_t group_size, uint32_t parity_count, size_t payload_length) {
+    encoder.group_size = group_size;
+    encoder.parity_count = parity_count;
+    encoder.payload_length = payload_length;
+    encoder.words = (payload_length + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    encoder.group = 0;
+    encoder.members = 0;
+    encoder.next_slot = 0;
+    std::memset(encoder.length_parity, 0, sizeof(encoder.length_parity));
+
+    if (group_size == 0) {
+        return true;
+    }
+
+    try {
+        encoder.parity.assign(static_cast<size_t>(parity_count) * encoder.words, 0);
+        encoder.slots.resize(FEC_PARITY_SLOTS * (FIXED_HEADER_LENGTH + payload_length));
+    } catch (const std::bad_alloc&) {
+        return false;
+    }
+
+    return true;
+}
+
+bool fec_add_packet(struct fec_encoder& encoder, uint32_t sequence_number, std::string_view payload, uint16_t data_length) {
+    uint32_t member = sequence_number % encoder.group_size;
+    uint32_t index = member % encoder.parity_count;
+
+    // Packets only ever arrive in order, but a group cut short by the end of the input must not leak into the next
+    if (sequence_number / encoder.group_size != encoder.group) {
+        fec_next_group(encoder);
+        encoder.group = sequence_number / encoder.group_size;
+    }
+
+    xor_into(&encoder.parity[index * encoder.words], payload.data(), std::min(payload.length(), encoder.payload_length));
+    encoder.length_parity[index] ^= data_length;
+    encoder.members = member + 1;
+
+    return encoder.members == encoder.group_size;
+}
+
+std::string_view fec_build_parity(struct fec_encoder& encoder, uint32_t index) {
+    size_t datagram_length = FIXED_HEADER_LENGTH + encoder.payload_length;
+    char * slot = &encoder.slots[encoder.next_slot * datagram_length];
+    encoder.next_slot = (encoder.next_slot + 1) % FEC_PARITY_SLOTS;
+
+    // The first member's number and the layout, which the receiver reads out of the ack field
+    uint32_t seq_number = htonl(encoder.group * encoder.group_size);
+    uint32_t layout = htonl(encoder.group_size << 24 | encoder.members << 16 | encoder.parity_count << 8 | index);
+    uint8_t flags = FEC_FLAG;
+    uint16_t data_length = htons(encoder.length_parity[index]);
+
+    std::memcpy(&slot[0], &seq_number, sizeof(seq_number));
+    std::memcpy(&slot[4], &layout, sizeof(layout));
+    std::memcpy(&slot[8], &flags, sizeof(flags));
+    std::memcpy(&slot[9], &data_length, sizeof(data_length));
+    // Always a full payload, so parity packets match the data packets' size and batch with them
+    std::memcpy(&slot[FIXED_HEADER_LENGTH], &encoder.parity[index * encoder.words], encoder.payload_length);
+
+    return std::string_view(slot, datagram_length);
+}
+
+void fec_next_group(struct fec_encoder& encoder) {
+    std::fill(encoder.parity.begin(), encoder.parity.end(), 0);
+    std::memset(encoder.length_parity, 0, sizeof(encoder.length_parity));
+    encoder.members = 0;
+    encoder.group++;
+}
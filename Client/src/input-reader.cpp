@@ -0,0 +1,111 @@
+#include "input-reader.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+
+/**
+ * @brief Top the buffer up until it holds a full payload or the input ends
+ * @param reader Input reader struct
+ * @param max_length Largest payload
+ * @return void
+ */
+static void fill_buffer(struct input_reader& reader, size_t max_length);
+
+bool open_input_file(struct input_reader& reader, const std::string& path) {
+    struct stat file_stat{};
+
+    reader.fd = open(path.c_str(), O_RDONLY);
+    if (reader.fd == -1) {
+        return false;
+    }
+
+    if (fstat(reader.fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode) && file_stat.st_size > 0) {
+        void * mapped = mmap(nullptr, static_cast<size_t>(file_stat.st_size), PROT_READ, MAP_PRIVATE, reader.fd, 0);
+
+        if (mapped != MAP_FAILED) {
+            // Read front to back once, let the kernel read ahead aggressively
+            madvise(mapped, static_cast<size_t>(file_stat.st_size), MADV_SEQUENTIAL);
+            reader.mapped = static_cast<const char *>(mapped);
+            reader.mapped_length = static_cast<size_t>(file_stat.st_size);
+            return true;
+        }
+    }
+
+    // Pipes, devices and empty files are read like a stream
+    open_input_stream(reader, reader.fd);
+    return true;
+}
+
+void open_input_stream(struct input_reader& reader, int fd) {
+    reader.fd = fd;
+    reader.buffer.resize(INPUT_BUFFER_SIZE);
+    reader.start = 0;
+    reader.end = 0;
+    reader.eof = false;
+}
+
+static void fill_buffer(struct input_reader& reader, size_t max_length) {
+    // Move the leftover to the front so the next block lands after it
+    if (reader.start > 0) {
+        std::memmove(reader.buffer.data(), reader.buffer.data() + reader.start, reader.end - reader.start);
+        reader.end -= reader.start;
+        reader.start = 0;
+    }
+
+    while (!reader.eof && reader.end < max_length) {
+        ssize_t bytes_read = read(reader.fd, reader.buffer.data() + reader.end, reader.buffer.size() - reader.end);
+
+        if (bytes_read > 0) {
+            reader.end += static_cast<size_t>(bytes_read);
+        } else if (bytes_read == 0 || errno != EINTR) {
+            reader.eof = true;
+        }
+    }
+}
+
+std::string_view next_payload(struct input_reader& reader, size_t max_length) {
+    if (reader.mapped != nullptr) {
+        size_t length = std::min(max_length, reader.mapped_length - reader.offset);
+        std::string_view payload(reader.mapped + reader.offset, length);
+        reader.offset += length;
+        return payload;
+    }
+
+    if (reader.end - reader.start < max_length) {
+        fill_buffer(reader, max_length);
+    }
+
+    size_t length = std::min(max_length, reader.end - reader.start);
+    std::string_view payload(reader.buffer.data() + reader.start, length);
+    reader.start += length;
+    return payload;
+}
+
+bool input_pending(const struct input_reader& reader, size_t max_length) {
+    if (reader.mapped != nullptr || reader.eof || reader.end - reader.start >= max_length) {
+        return true;
+    }
+
+    struct pollfd input{};
+    input.fd = reader.fd;
+    input.events = POLLIN;
+
+    return poll(&input, 1, 0) > 0;
+}
+
+void close_input(struct input_reader& reader) {
+    if (reader.mapped != nullptr) {
+        munmap(const_cast<char *>(reader.mapped), reader.mapped_length);
+        reader.mapped = nullptr;
+    }
+
+    if (reader.fd > STDERR_FILENO) {
+        close(reader.fd);
+    }
+    reader.fd = -1;
+}
@@ -4,6 +4,12 @@
 #include <getopt.h>
 #include <unistd.h>
 #include "transfer.hpp"
+#include "reliable-udp.hpp"
+#include "congestion-control.hpp"
+#include "input-reader.hpp"
+#include "stats-writer.hpp"
+#include "path-mtu.hpp"
+#include "fec.hpp"
 #include <csignal>
 #include <thread>
 #include <cstring>
@@ -17,9 +23,10 @@ using namespace std;
  * @param argc Program argument count
  * @param argv Program argument values
  * @param networkingOptions Networking options struct
+ * @param stats Stats writer, opened once the format is known
  * @return void
  */
-static void parse_arguments(int argc, char * argv[], struct networking_options& networkingOptions);
+static void parse_arguments(int argc, char * argv[], struct networking_options& networkingOptions, struct stats_writer& stats);
 /**
  * @brief Print the programs usage, clean resources and exits
  * @param networkingOptions Networking options struct
@@ -63,22 +70,30 @@ int main(int argc, char * argv[]) {
     // Get cmd line arguments
     struct networking_options networkingOptions{};
     struct header_field header{};
+    struct input_reader input{};
+    struct stats_writer stats{};
 
     header.sequence_number = -1;
     header.ack_number = 0;
     header.flags = 1;
     header.data_length = 0;
-    header.sent_counter = 0;
+    header.transmissions = 0;
 
     networkingOptions.header = &header;
     networkingOptions.socket_fd = -1;
     networkingOptions.program_name = argv[0];
-    networkingOptions.stats_file = fopen("output.txt", "w");
+    networkingOptions.stats = nullptr;
+    networkingOptions.binary_stats = false;
     networkingOptions.time_started = time(nullptr);
-    if (networkingOptions.stats_file == nullptr) {
-        perror("Failed to open file");
-        return EXIT_FAILURE;
-    }
+    networkingOptions.send_window_size = DEFAULT_WINDOW_SIZE;
+    networkingOptions.receiver_window_size = DEFAULT_WINDOW_SIZE;
+    networkingOptions.congestion_algorithm = DEFAULT_CONGESTION_CONTROL;
+    networkingOptions.pacing = false;
+    networkingOptions.pacing_rate = 0;
+    networkingOptions.link_mtu = DEFAULT_LINK_MTU;
+    networkingOptions.payload_length = MAX_PACKET_LENGTH;
+    networkingOptions.fec_group_size = 0;
+    networkingOptions.fec_parity_count = 0;
 
     if (isatty(fileno(stdin))) {
         networkingOptions.terminal_input = true;
@@ -86,12 +101,40 @@ int main(int argc, char * argv[]) {
         networkingOptions.terminal_input = false;
     }
 
-    parse_arguments(argc, argv, networkingOptions);
+    stats.fd = -1;
+    parse_arguments(argc, argv, networkingOptions, stats);
+
+    // A named file or redirected input is sent as a file transfer, read in bulk rather than a line at a time
+    if (!networkingOptions.input_file.empty()) {
+        networkingOptions.terminal_input = false;
+        if (!open_input_file(input, networkingOptions.input_file)) {
+            networkingOptions.message = "Failed to open input file";
+            display_error(networkingOptions);
+        }
+    } else if (!networkingOptions.terminal_input) {
+        open_input_stream(input, STDIN_FILENO);
+    }
+    networkingOptions.input = &input;
+    // A mapped file stays put for the whole transfer, so packets can point into it instead of keeping a copy
+    networkingOptions.stable_input = input.mapped != nullptr;
 
     if (!setup_connection(networkingOptions)) {
         display_error(networkingOptions);
     }
 
+    // The window's payload storage is sized by what the path carries
+    if (!negotiate_payload_length(networkingOptions)) {
+        display_error(networkingOptions);
+    }
+    cout << "Payload Size: " << networkingOptions.payload_length << endl;
+
+    if (!init_send_window(networkingOptions) || !init_ack_receiver(networkingOptions)) {
+        display_error(networkingOptions);
+    }
+
+    // Started after the graphing program is forked
+    start_stats_writer(stats);
+
     // Register signal interrupt
     signal(SIGINT, sigHandler);
 
@@ -103,6 +146,7 @@ int main(int argc, char * argv[]) {
     read_ack_response_thread.join();
 
     // Startup sending and receiving threads
+    close_input(input);
     clean_resources(networkingOptions);
 
     return EXIT_SUCCESS;
@@ -126,10 +170,111 @@ bool setup_connection(struct networking_options& networkingOptions) {
     return true;
 }
 
-void parse_arguments(int argc, char * argv[], struct networking_options& networkingOptions) {
+void parse_arguments(int argc, char * argv[], struct networking_options& networkingOptions, struct stats_writer& stats) {
+    int option;
+    bool start_graph = false;
     opterr = 0;
 
-    if((argc < 3) || (argc > 4))
+    while ((option = getopt(argc, argv, "gw:c:p:f:l:m:e:")) != -1) {
+        switch (option) {
+            case 'g':
+                start_graph = true;
+                break;
+            case 'f':
+                // Opened once the arguments are parsed
+                networkingOptions.input_file = optarg;
+                break;
+            case 'l':
+                // Handle Stats Format
+                if (std::strcmp(optarg, "binary") == 0) {
+                    networkingOptions.binary_stats = true;
+                } else if (std::strcmp(optarg, "csv") != 0) {
+                    networkingOptions.message = "Invalid Stats Format";
+                    display_error(networkingOptions);
+                }
+                break;
+            case 'c':
+                // Validated when the congestion controller is created
+                networkingOptions.congestion_algorithm = optarg;
+                break;
+            case 'w': {
+                // Handle Window Size
+                char * end_ptr;
+                long window = std::strtol(optarg, &end_ptr, 10);
+
+                if (*end_ptr != '\0' || window < 1 || window > MAX_WINDOW_SIZE) {
+                    networkingOptions.message = "Invalid Window Size";
+                    display_error(networkingOptions);
+                }
+
+                networkingOptions.send_window_size = static_cast<uint32_t>(window);
+                break;
+            }
+            case 'm': {
+                // Handle Link MTU, the largest the path search reaches for
+                char * end_ptr;
+                long mtu = std::strtol(optarg, &end_ptr, 10);
+
+                if (*end_ptr != '\0' || mtu < 0 || mtu > 65535) {
+                    networkingOptions.message = "Invalid Link MTU";
+                    display_error(networkingOptions);
+                }
+
+                networkingOptions.link_mtu = static_cast<uint32_t>(mtu);
+                break;
+            }
+            case 'e': {
+                // Handle Forward Error Correction, data packets per group and optionally parity packets per group
+                char * end_ptr;
+                long group_size = std::strtol(optarg, &end_ptr, 10);
+                long parity_count = 1;
+
+                if (*end_ptr == ':') {
+                    parity_count = std::strtol(end_ptr + 1, &end_ptr, 10);
+                }
+
+                if (*end_ptr != '\0' || group_size < 1 || group_size > MAX_FEC_GROUP || parity_count < 1 ||
+                    parity_count > MAX_FEC_PARITY || parity_count > group_size) {
+                    networkingOptions.message = "Invalid Forward Error Correction";
+                    display_error(networkingOptions);
+                }
+
+                networkingOptions.fec_group_size = static_cast<uint32_t>(group_size);
+                networkingOptions.fec_parity_count = static_cast<uint32_t>(parity_count);
+                break;
+            }
+            case 'p': {
+                // Handle Pacing, either automatic or a fixed rate in bytes per second
+                networkingOptions.pacing = true;
+                if (std::strcmp(optarg, "auto") == 0) {
+                    networkingOptions.pacing_rate = 0;
+                    break;
+                }
+
+                char * end_ptr;
+                double rate = std::strtod(optarg, &end_ptr);
+
+                if (*end_ptr != '\0' || !(rate > 0)) {
+                    networkingOptions.message = "Invalid Pacing Rate";
+                    display_error(networkingOptions);
+                }
+
+                networkingOptions.pacing_rate = rate;
+                break;
+            }
+            default:
+                networkingOptions.message = "Unknown option";
+                print_program_usage(networkingOptions);
+        }
+    }
+
+    // The graphing program only reads the csv stats
+    if (start_graph && networkingOptions.binary_stats) {
+        networkingOptions.message = "The graph needs csv stats, -g cannot be used with -l binary";
+        display_error(networkingOptions);
+    }
+
+    if((argc - optind) != 2)
     {
         networkingOptions.message = "Please give Receiver IP address, and port.";
         print_program_usage(networkingOptions);
@@ -155,23 +300,39 @@ void parse_arguments(int argc, char * argv[], struct networking_options& network
 
     check_ip_address(networkingOptions);
 
-    if (argc == 4) {
-        if (strcmp(argv[optind+2], "-g") == 0) {
-            // Fork and exec the graphing program
-            pid_t pid = fork();
-            if (pid == 0) {
-                int ret = execlp("python3", "python3", "main.py", "-c", "./output.txt", nullptr);
-                if (ret == -1) {
-                    perror("Failed to exec");
-                    exit(EXIT_FAILURE);
-                }
+    // Created before the graphing program goes looking for it
+    if (!open_stats_writer(stats, networkingOptions.binary_stats ? "output.bin" : "output.txt", networkingOptions.binary_stats)) {
+        networkingOptions.message = "Failed to open stats file";
+        display_error(networkingOptions);
+    }
+    networkingOptions.stats = &stats;
+
+    if (start_graph) {
+        // Fork and exec the graphing program
+        pid_t pid = fork();
+        if (pid == 0) {
+            int ret = execlp("python3", "python3", "main.py", "-c", "./output.txt", nullptr);
+            if (ret == -1) {
+                perror("Failed to exec");
+                exit(EXIT_FAILURE);
             }
-            cout << "Graphing Program Started" << endl;
-            networkingOptions.parent_pid = pid;
         }
+        cout << "Graphing Program Started" << endl;
+        networkingOptions.parent_pid = pid;
     }
     cout << "Sending to Ip Address: " << networkingOptions.receiver_ip_address << endl;
     cout << "Sending to Port: " << networkingOptions.receiver_port << endl;
+    cout << "Congestion Control: " << networkingOptions.congestion_algorithm << endl;
+    if (networkingOptions.fec_group_size > 0) {
+        cout << "Forward Error Correction: " << networkingOptions.fec_parity_count << " parity per " << networkingOptions.fec_group_size << " packets" << endl;
+    }
+    if (networkingOptions.pacing) {
+        if (networkingOptions.pacing_rate > 0) {
+            cout << "Pacing: " << networkingOptions.pacing_rate << " bytes/s" << endl;
+        } else {
+            cout << "Pacing: auto" << endl;
+        }
+    }
 
 }
 
@@ -197,7 +358,7 @@ static void print_program_usage(struct networking_options& networkingOptions) {
         cerr << networkingOptions.message << endl;
     }
 
-    cerr << "Usage: " << networkingOptions.program_name << " <receiver ip address>, <receiver port number>" << endl;
+    cerr << "Usage: " << networkingOptions.program_name << " <receiver ip address>, <receiver port number> [-g] [-w window size] [-c reno|cubic|none] [-p auto|bytes per second] [-f input file] [-l csv|binary] [-m link mtu] [-e group size[:parity count]]" << endl;
 
     clean_resources(networkingOptions);
 }
@@ -215,8 +376,8 @@ void clean_resources(struct networking_options& networkingOptions) {
         close(networkingOptions.socket_fd);
     }
 
-    if (networkingOptions.stats_file != nullptr) {
-        fclose(networkingOptions.stats_file);
+    if (networkingOptions.stats != nullptr) {
+        close_stats_writer(*networkingOptions.stats);
     }
 
     if (networkingOptions.parent_pid > 0) {
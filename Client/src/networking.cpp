@@ -90,7 +90,8 @@ bool bind_udp_socket(struct networking_options& networkingOptions) {
 
     server_address.sin_family = AF_INET;
     server_address.sin_addr.s_addr = inet_addr(networkingOptions.device_ip_address.c_str());
-    server_address.sin_port = htons(DEFAULT_PORT);
+    // Let the kernel pick the port, so several senders on one host get their own session at the receiver
+    server_address.sin_port = htons(0);
 
     if (bind(networkingOptions.socket_fd, (struct sockaddr *) &server_address, sizeof(server_address)) < 0) {
         perror("Bind Failed");
@@ -0,0 +1,73 @@
+#include "pacing.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+
+/**
+ * @brief Credit the tokens earned since the last refill
+ * @param pacer Pacer struct
+ * @param now Current time
+ * @return void
+ */
+static void pacer_refill(struct pacer& pacer, std::chrono::steady_clock::time_point now);
+
+static void pacer_refill(struct pacer& pacer, std::chrono::steady_clock::time_point now) {
+    if (now <= pacer.last_refill) {
+        return;
+    }
+
+    double elapsed = std::chrono::duration<double>(now - pacer.last_refill).count();
+    pacer.tokens = std::min(pacer.bucket_size, pacer.tokens + elapsed * pacer.rate);
+    pacer.last_refill = now;
+}
+
+void pacer_init(struct pacer& pacer, double bytes_per_second, double bucket_size) {
+    pacer.rate = bytes_per_second;
+    pacer.bucket_size = bucket_size;
+    pacer.tokens = bucket_size;
+    pacer.last_refill = std::chrono::steady_clock::now();
+}
+
+void pacer_set_rate(struct pacer& pacer, double bytes_per_second, std::chrono::steady_clock::time_point now) {
+    pacer_refill(pacer, now);
+    pacer.rate = bytes_per_second;
+}
+
+std::chrono::steady_clock::time_point pacer_release_time(struct pacer& pacer, size_t bytes, std::chrono::steady_clock::time_point now) {
+    // No rate yet means nothing to pace against
+    if (pacer.rate <= 0) {
+        return now;
+    }
+
+    pacer_refill(pacer, now);
+
+    double needed = std::min(static_cast<double>(bytes), pacer.bucket_size);
+    if (pacer.tokens >= needed) {
+        return now;
+    }
+
+    auto wait = std::chrono::duration<double>((needed - pacer.tokens) / pacer.rate);
+    return now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(wait);
+}
+
+void pacer_consume(struct pacer& pacer, size_t bytes, std::chrono::steady_clock::time_point now) {
+    if (pacer.rate <= 0) {
+        return;
+    }
+
+    pacer_refill(pacer, now);
+
+    // Retransmissions may push the bucket into debt, which holds back new data by the same amount
+    pacer.tokens = std::max(pacer.tokens - static_cast<double>(bytes), -pacer.bucket_size);
+}
+
+void pacer_sleep_until(std::chrono::steady_clock::time_point release) {
+    auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(release.time_since_epoch()).count();
+    struct timespec wake_time{};
+    wake_time.tv_sec = static_cast<time_t>(since_epoch / 1000000000);
+    wake_time.tv_nsec = static_cast<long>(since_epoch % 1000000000);
+
+    // steady_clock is CLOCK_MONOTONIC, so an absolute sleep on it wakes at exactly the release time
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake_time, nullptr) == EINTR) {
+    }
+}
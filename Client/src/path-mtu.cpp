@@ -0,0 +1,235 @@
+#include "path-mtu.hpp"
+#include "networking.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+
+/**
+ * @brief Set the don't fragment bit without the kernel's own path MTU cache getting in the way, or restore the old setting
+ * @param networkingOptions Networking options struct
+ * @param previous Setting to restore, filled in when enabling
+ * @param enable True to start probing, false to restore
+ * @return void
+ */
+static void set_probe_mode(struct networking_options& networkingOptions, int& previous, bool enable);
+/**
+ * @brief Send one padded probe of an exact datagram size
+ * @param networkingOptions Networking options struct
+ * @param probe_id Number the receiver echoes back
+ * @param size Datagram length
+ * @param payload_length Payload size to settle on, 0 while still searching
+ * @return 0 if sent, -1 otherwise with errno set
+ */
+static int send_probe(struct networking_options& networkingOptions, uint32_t probe_id, size_t size, uint32_t payload_length);
+/**
+ * @brief Collect acknowledgements of a round of probes, waiting one more round trip after the first answer
+ * @param networkingOptions Networking options struct
+ * @param first_id Number of the first probe of the round
+ * @param acked One entry per probe of the round, set as their acknowledgements arrive
+ * @param sent When the round was sent
+ * @return True if any probe of the round was acknowledged
+ */
+static bool wait_for_probe_acks(struct networking_options& networkingOptions, uint32_t first_id, std::vector<bool>& acked,
+                                std::chrono::steady_clock::time_point sent);
+
+static void set_probe_mode(struct networking_options& networkingOptions, int& previous, bool enable) {
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE) && defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_PROBE)
+    int level = networkingOptions.ip_family == AF_INET ? IPPROTO_IP : IPPROTO_IPV6;
+    int name = networkingOptions.ip_family == AF_INET ? IP_MTU_DISCOVER : IPV6_MTU_DISCOVER;
+    int mode = networkingOptions.ip_family == AF_INET ? IP_PMTUDISC_PROBE : IPV6_PMTUDISC_PROBE;
+    socklen_t length = sizeof(previous);
+
+    if (enable) {
+        if (getsockopt(networkingOptions.socket_fd, level, name, &previous, &length) == -1) {
+            previous = -1;
+            return;
+        }
+    } else if (previous == -1) {
+        return;
+    } else {
+        mode = previous;
+    }
+
+    if (setsockopt(networkingOptions.socket_fd, level, name, &mode, sizeof(mode)) == -1) {
+        perror("Path MTU discovery mode unavailable");
+    }
+#else
+    (void) networkingOptions;
+    (void) enable;
+    previous = -1;
+#endif
+}
+
+static int send_probe(struct networking_options& networkingOptions, uint32_t probe_id, size_t size, uint32_t payload_length) {
+    // Zero padding reads as an empty payload, the trailer closes it like any packet
+    std::vector<char> probe(size, '\0');
+    uint32_t seq_number = htonl(probe_id);
+    uint32_t ack_number = htonl(payload_length);
+    uint8_t flags = PROBE_FLAG;
+    uint16_t data_length = htons(static_cast<uint16_t>(size - FIXED_HEADER_LENGTH));
+
+    std::memcpy(&probe[0], &seq_number, sizeof(seq_number));
+    std::memcpy(&probe[4], &ack_number, sizeof(ack_number));
+    std::memcpy(&probe[8], &flags, sizeof(flags));
+    std::memcpy(&probe[9], &data_length, sizeof(data_length));
+    probe[size - 2] = '\x03';
+    probe[size - 1] = '\x03';
+
+    ssize_t ret_status;
+    if (networkingOptions.ip_family == AF_INET) {
+        ret_status = sendto(networkingOptions.socket_fd, probe.data(), size, 0, (struct sockaddr *) &networkingOptions.ipv4_addr, sizeof(networkingOptions.ipv4_addr));
+    } else {
+        ret_status = sendto(networkingOptions.socket_fd, probe.data(), size, 0, (struct sockaddr *) &networkingOptions.ipv6_addr, sizeof(networkingOptions.ipv6_addr));
+    }
+
+    return ret_status < 0 ? -1 : 0;
+}
+
+static bool wait_for_probe_acks(struct networking_options& networkingOptions, uint32_t first_id, std::vector<bool>& acked,
+                                std::chrono::steady_clock::time_point sent) {
+    auto deadline = sent + std::chrono::milliseconds(PROBE_TIMEOUT_MS);
+    bool answered = false;
+    size_t remaining = acked.size();
+
+    while (remaining > 0) {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            break;
+        }
+
+        struct pollfd socket_event{};
+        socket_event.fd = networkingOptions.socket_fd;
+        socket_event.events = POLLIN;
+        auto wait = std::chrono::ceil<std::chrono::milliseconds>(deadline - now);
+
+        int ready = poll(&socket_event, 1, static_cast<int>(wait.count()));
+        if (ready < 0 && errno != EINTR) {
+            perror("Probe poll failed");
+            break;
+        }
+        if (ready <= 0) {
+            continue;
+        }
+
+        char buffer[MAX_ACK_LENGTH];
+        ssize_t length = recv(networkingOptions.socket_fd, buffer, sizeof(buffer), 0);
+        if (length < HEADER_LENGTH || !(buffer[8] & PROBE_FLAG)) {
+            continue;
+        }
+
+        uint32_t ack_number;
+        std::memcpy(&ack_number, &buffer[4], sizeof(ack_number));
+        uint32_t index = ntohl(ack_number) - first_id;
+
+        // Late answers to an earlier round are already accounted for
+        if (index >= acked.size() || acked[index]) {
+            continue;
+        }
+        acked[index] = true;
+        remaining--;
+
+        // Every probe of the round left together, so the rest are due within about one more round trip
+        if (!answered) {
+            answered = true;
+            auto round_trip = std::max<std::chrono::steady_clock::duration>(std::chrono::steady_clock::now() - sent, std::chrono::milliseconds(1));
+            deadline = std::min(deadline, std::chrono::steady_clock::now() + round_trip);
+        }
+    }
+
+    return answered;
+}
+
+bool negotiate_payload_length(struct networking_options& networkingOptions) {
+    size_t overhead = networkingOptions.ip_family == AF_INET ? IPV4_UDP_OVERHEAD : IPV6_UDP_OVERHEAD;
+    size_t low = BASE_DATAGRAM_LENGTH;
+    size_t high = networkingOptions.link_mtu > overhead ? std::min<size_t>(networkingOptions.link_mtu - overhead, MAX_DATAGRAM_LENGTH) : 0;
+    uint32_t next_probe_id = 0;
+    int silent_rounds = 0;
+    int previous_mode;
+
+    networkingOptions.payload_length = MAX_PACKET_LENGTH;
+
+    // Probing costs round trips before the first byte of data, so it is only done when asked for
+    if (networkingOptions.link_mtu == 0) {
+        return true;
+    }
+
+    set_probe_mode(networkingOptions, previous_mode, true);
+
+    // Each round probes the floor, to time the round, and sizes spread up to the ceiling, which is always included
+    while (high > low + PROBE_GRANULARITY && silent_rounds < PROBE_MAX_ROUNDS) {
+        std::vector<size_t> sizes{low};
+        for (size_t i = 1; i <= PROBE_CANDIDATES; ++i) {
+            sizes.push_back(low + (high - low) * i / PROBE_CANDIDATES);
+        }
+
+        std::vector<bool> acked(sizes.size(), false);
+        uint32_t first_id = next_probe_id;
+        next_probe_id += static_cast<uint32_t>(sizes.size());
+        auto sent = std::chrono::steady_clock::now();
+
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            // Too big for the local interface is answered right here, it simply never gets acknowledged
+            if (send_probe(networkingOptions, first_id + static_cast<uint32_t>(i), sizes[i], 0) == -1 && errno != EMSGSIZE) {
+                perror("Probe Failed To Send");
+            }
+        }
+
+        // Nothing came back, not even the floor, so the round says nothing about size
+        if (!wait_for_probe_acks(networkingOptions, first_id, acked, sent)) {
+            silent_rounds++;
+            continue;
+        }
+        silent_rounds = 0;
+
+        // The largest size through is the new floor, the first size above it that was lost caps the search
+        size_t new_low = low;
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            if (acked[i]) {
+                new_low = std::max(new_low, sizes[i]);
+            }
+        }
+        for (size_t i = 0; i < sizes.size(); ++i) {
+            if (!acked[i] && sizes[i] > new_low) {
+                high = sizes[i] - 1;
+                break;
+            }
+        }
+        low = new_low;
+        high = std::max(high, low);
+    }
+
+    set_probe_mode(networkingOptions, previous_mode, false);
+
+    // The receiver already assumes the base size
+    if (low == BASE_DATAGRAM_LENGTH) {
+        return true;
+    }
+
+    // Settle the size, the receiver places file blocks by it, so it has to hear it before any data
+    auto payload_length = static_cast<uint32_t>(low - FIXED_HEADER_LENGTH - 3);
+    for (int attempt = 0; attempt < PROBE_CONFIRM_TRIES; ++attempt) {
+        std::vector<bool> acked(1, false);
+        uint32_t probe_id = next_probe_id++;
+        auto sent = std::chrono::steady_clock::now();
+
+        if (send_probe(networkingOptions, probe_id, FIXED_HEADER_LENGTH + 3, payload_length) == -1) {
+            perror("Probe Failed To Send");
+        }
+        if (wait_for_probe_acks(networkingOptions, probe_id, acked, sent)) {
+            networkingOptions.payload_length = payload_length;
+            return true;
+        }
+    }
+
+    networkingOptions.message = "Receiver did not confirm the payload size";
+    return false;
+}
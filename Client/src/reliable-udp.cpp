@@ -1,64 +1,301 @@
 #include "reliable-udp.hpp"
 #include "networking.hpp"
+#include "rtt-estimator.hpp"
+#include "timer-wheel.hpp"
+#include "congestion-control.hpp"
+#include "pacing.hpp"
+#include "send-batch.hpp"
+#include "stats-writer.hpp"
+#include "ack-events.hpp"
+#include "fec.hpp"
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
 #include <vector>
 #include <cstring>
-#include <mutex>
+#include <atomic>
 #include <iostream>
-#include <sys/time.h>
+#include <algorithm>
+#include <memory>
 
 /**
- * @brief Mutex to lock the sent packets vector
+ * @brief Packet awaiting acknowledgement along with its retransmission timer
+ *
+ * The sender thread fills the slot and publishes it by advancing next_sequence_number, from then on only the
+ * acknowledgement thread touches it until send_base moves past it and hands it back
  */
-std::mutex modifying_global_variables;
+struct in_flight_packet {
+    struct header_field header;
+    struct timer_node timer;
+    bool in_flight;
+    bool fast_retransmitted;
+    char header_bytes[FIXED_HEADER_LENGTH];
+    char retransmission_bytes[FIXED_HEADER_LENGTH];
+};
+
+/**
+ * @brief Decoded acknowledgement, including the selective part when the receiver sends one
+ */
+struct acknowledgement {
+    uint32_t ack_number;
+    uint8_t flags;
+    uint32_t receiver_window;
+    bool selective;
+    uint32_t cumulative_ack;
+    uint8_t block_count;
+    uint32_t blocks[SACK_MAX_BLOCKS][2];
+};
+
+/**
+ * @brief Power of two ring of sent packets, indexed by sequence number
+ */
+std::vector<in_flight_packet> sent_packets;
+/**
+ * @brief Payload bytes of every slot in the ring, used when the input is not a mapped file that outlives the packets
+ */
+std::vector<char> payload_storage;
+/**
+ * @brief Null character then two ETX characters closing every packet
+ */
+const char packet_trailer[3] = {'\0', '\x03', '\x03'};
 /**
- * @brief Vector containing all the sent packets
+ * @brief Mask mapping a sequence number onto its slot in the sent packets ring
  */
-std::vector<header_field> sent_packets = std::vector<header_field>();
+uint32_t sent_packets_mask = 0;
+/**
+ * @brief Oldest sequence number not yet acknowledged, advanced by the acknowledgement thread
+ */
+std::atomic<uint32_t> send_base = 0;
+/**
+ * @brief Sequence number the next new packet will use, published by the sender thread once the slot before it is filled
+ */
+std::atomic<uint32_t> next_sequence_number = 0;
+/**
+ * @brief One past the newest packet the acknowledgement thread has taken over and armed a timer for
+ */
+uint32_t tracked_sequence_number = 0;
 /**
  * @brief Count of the number of packets in the window
  */
-int window_size = 0;
+std::atomic<uint32_t> window_size = 0;
+/**
+ * @brief Congestion window as last published by the acknowledgement thread
+ */
+std::atomic<uint32_t> congestion_window_limit = 0;
+/**
+ * @brief Receive window last advertised by the receiver
+ */
+std::atomic<uint32_t> receiver_window = DEFAULT_WINDOW_SIZE;
+/**
+ * @brief Pacing rate chosen by the acknowledgement thread for the sender thread to apply, negative when unchanged
+ */
+std::atomic<double> pending_pacing_rate = -1.0;
+/**
+ * @brief Retransmitted bytes the sender thread still has to charge to the pacer
+ */
+std::atomic<size_t> retransmitted_bytes = 0;
+/**
+ * @brief Set while the sender thread waits for window space, so acknowledgements only wake it when it sleeps
+ */
+std::atomic<bool> sender_waiting = false;
+/**
+ * @brief Eventfd the acknowledgement thread signals when window space frees up
+ */
+int window_event_fd = -1;
+/**
+ * @brief Set while the acknowledgement thread sleeps with no retransmission timer armed, so new packets wake it
+ */
+std::atomic<bool> ack_thread_idle = false;
+/**
+ * @brief Socket, retransmission timer and sender wakeup the acknowledgement thread waits on together
+ */
+struct ack_events ack_events{-1, -1, -1, -1, false, {}};
+/**
+ * @brief Acknowledgements drained from the socket in one pass
+ */
+struct ack_batch incoming_acks;
+/**
+ * @brief Round trip time estimator driving the retransmission timeout
+ */
+struct rtt_estimator rtt_estimator;
+/**
+ * @brief Retransmission deadlines of every packet in the window
+ */
+struct timer_wheel retransmission_timers;
+/**
+ * @brief Congestion controller selected for this run
+ */
+std::unique_ptr<congestion_controller> congestion_control;
+/**
+ * @brief Token bucket spacing packets out at the configured rate or at the congestion window per round trip, owned by the sender thread
+ */
+struct pacer pacer;
+/**
+ * @brief New packets packed by the sender thread and not yet handed to the kernel
+ */
+struct send_batch outgoing_packets;
+/**
+ * @brief Parity over the packets the sender thread sends, owned by it
+ */
+struct fec_encoder fec_encoder;
+/**
+ * @brief Expired packets packed for retransmission by the receiver thread
+ */
+struct send_batch retransmitted_packets;
+/**
+ * @brief Selective ack blocks already applied, so repeated blocks are not walked again
+ */
+uint32_t processed_sack_blocks[SACK_MAX_BLOCKS][2];
+/**
+ * @brief Number of entries in processed_sack_blocks
+ */
+uint8_t processed_sack_block_count = 0;
+/**
+ * @brief Newest sequence number the receiver is known to hold
+ */
+uint32_t highest_acknowledged = 0;
+/**
+ * @brief Packets below this have already been checked for loss against highest_acknowledged
+ */
+uint32_t loss_scan_cursor = 0;
+/**
+ * @brief Cumulative ack carried by the last selective acknowledgement
+ */
+uint32_t last_cumulative_ack = 0;
+/**
+ * @brief Selective acknowledgements in a row that did not move the cumulative ack
+ */
+uint32_t duplicate_acks = 0;
+/**
+ * @brief Packets released by the acknowledgements of the current batch
+ */
+uint32_t newly_acknowledged = 0;
+/**
+ * @brief Set while a tail loss probe is scheduled
+ */
+bool tail_probe_armed = false;
+/**
+ * @brief When the tail loss probe goes out if no acknowledgement comes first
+ */
+std::chrono::steady_clock::time_point tail_probe_deadline;
+/**
+ * @brief Set from sending a tail loss probe until an acknowledgement releases a packet
+ */
+bool tail_probe_outstanding = false;
+/**
+ * @brief Sequence number the last tail loss probe resent
+ */
+uint32_t tail_probe_sequence = 0;
 
 /**
- * @brief Pack the header into a string
- * @param header Header struct
- * @return String containing the header
+ * @brief Check whether the next packet fits inside both windows and the congestion window
+ * @param networkingOptions Networking options struct
+ * @param sequence_number Sequence number of the next packet
+ * @return True if it may be sent
+ */
+bool window_has_room(struct networking_options& networkingOptions, uint32_t sequence_number);
+/**
+ * @brief Apply pacing rate changes and retransmissions the acknowledgement thread passed over
+ * @param now Current time
+ * @return void
  */
-std::string pack_header(struct header_field* header);
+void sync_pacer(std::chrono::steady_clock::time_point now);
 /**
- * @brief Increment the sent counter for each packet in the sent packets vector
+ * @brief Take over the packets the sender thread published since the last call and arm their timers
  * @return void
  */
-void increment_sent_counter();
+void track_new_packets();
 /**
- * @brief Send a packet to the receiver
+ * @brief Publish the congestion window and wake the sender thread if it waits for space
+ * @return void
+ */
+void publish_window();
+/**
+ * @brief Pack the fixed part of the header
+ * @param header Header struct
+ * @param buffer Buffer of FIXED_HEADER_LENGTH bytes
+ * @return void
+ */
+void pack_header(struct header_field* header, char * buffer);
+/**
+ * @brief Add a packet to a batch as its header, payload and trailer, without copying the payload
+ * @param batch Batch to add to
+ * @param sent_packet Packet to add
+ * @param header_bytes Scratch bytes of the packet to pack its header into, one set per thread
+ * @return Length of the datagram
+ */
+size_t add_packet_to_batch(struct send_batch& batch, struct in_flight_packet& sent_packet, char * header_bytes);
+/**
+ * @brief Queue every parity packet of the group so far behind the data packets, then start the next group
  * @param networkingOptions Networking options struct
- * @param packet Packet to send
- * @return Number of bytes sent
+ * @param now Current time
+ * @return 0 if successful, -1 if a full batch could not be sent
  */
-ssize_t send_packet_over(struct networking_options& networkingOptions, const std::string& packet);
+int queue_parity(struct networking_options& networkingOptions, std::chrono::steady_clock::time_point now);
 /**
- * @brief Iterate over the sent packets and check if any need to be retransmitted
+ * @brief Send every packet in a batch to the receiver
+ * @param networkingOptions Networking options struct
+ * @param batch Batch of packed packets, empty afterwards
+ * @return Number of packets sent, -1 if none could be
+ */
+ssize_t send_packets_over(struct networking_options& networkingOptions, struct send_batch& batch);
+/**
+ * @brief Queue a packet for retransmission and rearm its timer
+ * @param networkingOptions Networking options struct
+ * @param sent_packet Packet to retransmit
+ * @param now Current time
+ * @param rto Retransmission timeout to rearm the timer with
+ * @return void
+ */
+void retransmit_packet(struct networking_options& networkingOptions, struct in_flight_packet& sent_packet,
+                       std::chrono::steady_clock::time_point now, std::chrono::microseconds rto);
+/**
+ * @brief Retransmit every packet whose retransmission timer has expired
  * @param networkingOptions Networking options struct
  * @return void
  */
 void check_need_for_retransmission(struct networking_options& networkingOptions);
 /**
- * @brief Decode the string into a header struct
- * @param packet_raw String containing the packet
- * @return Acknowledgement number
+ * @brief Retransmit a packet the acknowledgements show to be lost, at most once per transmission from the sender thread
+ * @param networkingOptions Networking options struct
+ * @param sequence_number Sequence number of the lost packet
+ * @param now Current time
+ * @return True if it was queued for retransmission
+ */
+bool fast_retransmit(struct networking_options& networkingOptions, uint32_t sequence_number, std::chrono::steady_clock::time_point now);
+/**
+ * @brief Find packets lost without waiting for their timers: FAST_RETRANSMIT_THRESHOLD later packets acknowledged,
+ *        or as many selective acknowledgements in a row stuck on the same cumulative ack
+ * @param networkingOptions Networking options struct
+ * @return void
+ */
+void detect_lost_packets(struct networking_options& networkingOptions);
+/**
+ * @brief Schedule the tail loss probe about two round trips out, or cancel it when nothing is outstanding or a probe
+ *        is still unanswered
+ * @param now Time of the send or acknowledgement the probe is timed from
+ * @return void
  */
-uint32_t decode_string(char * packet_raw);
+void schedule_tail_probe(std::chrono::steady_clock::time_point now);
 /**
- * @brief Write the data to the file
- * @param stats_file File to write to
- * @param sequence_number Sequence number of the packet
- * @param time_taken Time taken to receive acknowledgement
+ * @brief Resend the newest outstanding packet once the tail loss probe is due, so its acknowledgement reveals any loss
+ *        at the end of the flight well before the retransmission timer
+ * @param networkingOptions Networking options struct
  * @return void
  */
-void write_data_to_file(FILE * stats_file, uint32_t sequence_number, time_t time_taken);
+void check_need_for_tail_probe(struct networking_options& networkingOptions);
+/**
+ * @brief Decode the string into an acknowledgement struct
+ * @param packet_raw String containing the packet
+ * @param length Number of bytes received
+ * @param ack Acknowledgement struct, receiver_window is left untouched if not advertised
+ * @return Acknowledgement number
+ */
+uint32_t decode_string(char * packet_raw, ssize_t length, struct acknowledgement& ack);
 /**
  * @brief Remove the packet from the list of sent packets
  * @param networkingOptions Networking options struct
@@ -66,90 +303,376 @@ void write_data_to_file(FILE * stats_file, uint32_t sequence_number, time_t time
  * @return void
  */
 void remove_packet_from_sent_packets(struct networking_options& networkingOptions, uint32_t ack_number);
+/**
+ * @brief Feed the round trip time of the acknowledged packet to the RTT estimator
+ * @param ack_number Acknowledgement number
+ * @return void
+ */
+void sample_round_trip_time(uint32_t ack_number);
+/**
+ * @brief Remove every packet in a range of sequence numbers from the list of sent packets
+ * @param networkingOptions Networking options struct
+ * @param start First sequence number of the range
+ * @param end One past the last sequence number of the range
+ * @return void
+ */
+void remove_acknowledged_range(struct networking_options& networkingOptions, uint32_t start, uint32_t end);
+/**
+ * @brief Apply the cumulative ack and the blocks of a selective acknowledgement
+ * @param networkingOptions Networking options struct
+ * @param ack Decoded acknowledgement
+ * @return void
+ */
+void process_selective_ack(struct networking_options& networkingOptions, const struct acknowledgement& ack);
+/**
+ * @brief Retune an automatic pacer to the congestion window spread over the smoothed round trip time
+ * @param networkingOptions Networking options struct
+ * @return void
+ */
+void update_pacing_rate(struct networking_options& networkingOptions);
+/**
+ * @brief Decode one acknowledgement and release every packet it covers
+ * @param networkingOptions Networking options struct
+ * @param buffer Datagram received
+ * @param length Number of bytes received
+ * @return Acknowledgement number
+ */
+uint32_t process_acknowledgement(struct networking_options& networkingOptions, char * buffer, ssize_t length);
 
-std::string pack_header(struct header_field * header) {
+void pack_header(struct header_field * header, char * buffer) {
     header->data_length = header->data.length() + 3;
     uint32_t seq_number  = htonl(header->sequence_number);
     uint32_t ack_number  = htonl(header->ack_number);
-    uint8_t flags        = htons(header->flags);
+    uint8_t flags        = header->flags;
     uint16_t data_length = htons(header->data_length);
+    size_t offset = 0;
 
-    std::string packet;
-    packet.append(reinterpret_cast<const char *>(&seq_number), sizeof(seq_number));
-    packet.append(reinterpret_cast<const char *>(&ack_number), sizeof(ack_number));
-    packet.append(reinterpret_cast<const char *>(&flags), sizeof(flags));
-    packet.append(reinterpret_cast<const char *>(&data_length), sizeof(data_length));
-    packet.append(header->data);
-    packet.append("\0", 1);        // Append a null character with length 1
-    packet.append("\x03\x03", 2);  // Append two ETX characters
-
-    return packet;
+    std::memcpy(&buffer[offset], &seq_number, sizeof(seq_number));
+    offset += sizeof(seq_number);
+    std::memcpy(&buffer[offset], &ack_number, sizeof(ack_number));
+    offset += sizeof(ack_number);
+    std::memcpy(&buffer[offset], &flags, sizeof(flags));
+    offset += sizeof(flags);
+    std::memcpy(&buffer[offset], &data_length, sizeof(data_length));
 }
 
-void increment_sent_counter() {
-    // Iterate over the elements up to a maximum of the first five
-    for (size_t i = 0; i < std::min(sent_packets.size(), static_cast<size_t>((WINDOW_SIZE + 1))); ++i) {
-        auto& sent_packet = sent_packets[i];
-        sent_packet.sent_counter++;
+size_t add_packet_to_batch(struct send_batch& batch, struct in_flight_packet& sent_packet, char * header_bytes) {
+    struct iovec parts[SEND_BATCH_PARTS];
+
+    pack_header(&sent_packet.header, header_bytes);
 
+    // Gathered by the kernel straight from where each piece lives
+    parts[0].iov_base = header_bytes;
+    parts[0].iov_len = FIXED_HEADER_LENGTH;
+    parts[1].iov_base = const_cast<char *>(sent_packet.header.data.data());
+    parts[1].iov_len = sent_packet.header.data.length();
+    parts[2].iov_base = const_cast<char *>(packet_trailer);
+    parts[2].iov_len = sizeof(packet_trailer);
+    send_batch_add(batch, parts, SEND_BATCH_PARTS);
+
+    return FIXED_HEADER_LENGTH + sent_packet.header.data.length() + sizeof(packet_trailer);
+}
+
+ssize_t send_packets_over(struct networking_options& networkingOptions, struct send_batch& batch) {
+    if (networkingOptions.ip_family == AF_INET) {
+        return send_batch_flush(batch, networkingOptions.socket_fd, (struct sockaddr *) &networkingOptions.ipv4_addr, sizeof(networkingOptions.ipv4_addr));
     }
+
+    return send_batch_flush(batch, networkingOptions.socket_fd, (struct sockaddr *) &networkingOptions.ipv6_addr, sizeof(networkingOptions.ipv6_addr));
 }
 
-ssize_t send_packet_over(struct networking_options& networkingOptions, const std::string& packet) {
-    ssize_t ret_status;
+bool init_send_window(struct networking_options& networkingOptions) {
+    uint32_t capacity = 1;
 
-    if (networkingOptions.ip_family == AF_INET) {
-        ret_status = sendto(networkingOptions.socket_fd, packet.c_str(), packet.length(), 0, (struct sockaddr *) &networkingOptions.ipv4_addr, sizeof(networkingOptions.ipv4_addr));
-    } else {
-        ret_status = sendto(networkingOptions.socket_fd, packet.c_str(), packet.length(), 0, (struct sockaddr *) &networkingOptions.ipv6_addr, sizeof(networkingOptions.ipv6_addr));
+    // Round up to a power of two so a sequence number maps to its slot with a mask
+    while (capacity < networkingOptions.send_window_size) {
+        capacity <<= 1;
     }
 
-    return ret_status;
+    try {
+        sent_packets.resize(capacity);
+        if (!networkingOptions.stable_input) {
+            payload_storage.resize(static_cast<size_t>(capacity) * networkingOptions.payload_length);
+        }
+    } catch (const std::bad_alloc&) {
+        networkingOptions.message = "Failed to allocate send window";
+        return false;
+    }
+
+    sent_packets_mask = capacity - 1;
+
+    if (!init_fec_encoder(fec_encoder, networkingOptions.fec_group_size, networkingOptions.fec_parity_count, networkingOptions.payload_length)) {
+        networkingOptions.message = "Failed to allocate parity";
+        return false;
+    }
+
+    congestion_control = make_congestion_controller(networkingOptions.congestion_algorithm);
+    if (congestion_control == nullptr) {
+        networkingOptions.message = "Unknown congestion control algorithm";
+        return false;
+    }
+
+    networkingOptions.current_window_size = congestion_control->congestion_window();
+    congestion_window_limit = congestion_control->congestion_window();
+    receiver_window = networkingOptions.receiver_window_size;
+
+#ifdef __linux__
+    window_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (window_event_fd == -1) {
+        networkingOptions.message = "Failed to create window eventfd";
+        return false;
+    }
+#endif
+
+    // An automatic pacer stays open until the first round trip is measured
+    double pacing_rate = networkingOptions.pacing ? networkingOptions.pacing_rate : 0;
+    pacer_init(pacer, pacing_rate, PACING_BURST_PACKETS * (HEADER_LENGTH + 1 + networkingOptions.payload_length));
+    return true;
 }
 
-int send_packet(struct networking_options& networkingOptions) {
-    ssize_t ret_status;
+bool window_has_room(struct networking_options& networkingOptions, uint32_t sequence_number) {
+    uint32_t window_limit = std::min(networkingOptions.send_window_size, receiver_window.load());
 
-    // Make sure the window size is not exceeded
-    if (window_size > WINDOW_SIZE) {
-        return 1;
+    return sequence_number - send_base < window_limit && window_size < congestion_window_limit;
+}
+
+void sync_pacer(std::chrono::steady_clock::time_point now) {
+    double rate = pending_pacing_rate.exchange(-1.0);
+    if (rate >= 0) {
+        pacer_set_rate(pacer, rate, now);
     }
 
-    std::string packet = pack_header(networkingOptions.header);
+    size_t bytes = retransmitted_bytes.exchange(0);
+    if (bytes > 0) {
+        pacer_consume(pacer, bytes, now);
+    }
+}
 
-    modifying_global_variables.lock();
+int send_packet(struct networking_options& networkingOptions) {
+    int blocked = 0;
+    uint32_t sequence_number = networkingOptions.header->sequence_number;
+    size_t packet_length = HEADER_LENGTH + 1 + networkingOptions.header->data.length();
+    auto now = std::chrono::steady_clock::now();
 
-    // Add to sent packets
-    sent_packets.push_back(*networkingOptions.header);
+    sync_pacer(now);
 
-    // Send the packet
-    ret_status = send_packet_over(networkingOptions, packet);
+    // Make sure the packet falls inside both our window and the receiver's, and the network has room for it
+    if (!window_has_room(networkingOptions, sequence_number)) {
+        blocked = 1;
+    } else if (pacer_release_time(pacer, packet_length, now) > now) {
+        blocked = 2;
+    }
 
-    if (ret_status < 0) {
+    // Nothing more can join the batch for now, so send what is already queued
+    if ((blocked || send_batch_full(outgoing_packets)) && send_packets_over(networkingOptions, outgoing_packets) < 0) {
         perror("Send Failed");
         return -1;
     }
 
+    if (blocked) {
+        return blocked;
+    }
+
+    // The slot's previous packet is below send_base, so the acknowledgement thread is done with it
+    auto& sent_packet = sent_packets[sequence_number & sent_packets_mask];
+    sent_packet.header = *networkingOptions.header;
+    // Keep the only copy of the payload in the slot unless the mapped input already holds it
+    if (!networkingOptions.stable_input) {
+        char * storage = &payload_storage[static_cast<size_t>(sequence_number & sent_packets_mask) * networkingOptions.payload_length];
+        std::memcpy(storage, networkingOptions.header->data.data(), networkingOptions.header->data.length());
+        sent_packet.header.data = std::string_view(storage, networkingOptions.header->data.length());
+    }
+
+    // Stamp the packet so the acknowledgement can be timed
+    sent_packet.header.sent_time = now;
+    sent_packet.header.transmissions = 1;
+
+    add_packet_to_batch(outgoing_packets, sent_packet, sent_packet.header_bytes);
+    pacer_consume(pacer, packet_length, now);
+
+    // Parity follows the last packet of each group, so it reaches the receiver while the group's gaps are fresh
+    if (fec_encoder.group_size > 0 &&
+        fec_add_packet(fec_encoder, sequence_number, sent_packet.header.data, sent_packet.header.data_length) &&
+        queue_parity(networkingOptions, now) < 0) {
+        perror("Parity Failed To Send");
+    }
+
+    // Hand the slot over, the acknowledgement thread arms its timer when it next looks
     window_size++;
-    increment_sent_counter();
+    next_sequence_number = sequence_number + 1;
 
-    modifying_global_variables.unlock();
+    // Unless it sleeps with no timer that would bring it back to look
+    if (ack_thread_idle.load(std::memory_order_relaxed) && ack_thread_idle.exchange(false)) {
+        signal_ack_events(ack_events);
+    }
 
     return 0;
 }
 
+int queue_parity(struct networking_options& networkingOptions, std::chrono::steady_clock::time_point now) {
+    int status = 0;
+
+    for (uint32_t index = 0; index < fec_encoder.parity_count; ++index) {
+        if (send_batch_full(outgoing_packets) && send_packets_over(networkingOptions, outgoing_packets) < 0) {
+            status = -1;
+        }
+
+        // Never tracked or retransmitted, a lost parity packet only means its group waits for retransmissions
+        std::string_view datagram = fec_build_parity(fec_encoder, index);
+        struct iovec parts[2];
+        parts[0].iov_base = const_cast<char *>(datagram.data());
+        parts[0].iov_len = datagram.length();
+        parts[1].iov_base = const_cast<char *>(packet_trailer);
+        parts[1].iov_len = sizeof(packet_trailer);
+        send_batch_add(outgoing_packets, parts, 2);
 
-uint32_t decode_string(char * packet_raw) {
+        // Paced like any packet, but outside the windows since nothing acknowledges it
+        pacer_consume(pacer, datagram.length() + sizeof(packet_trailer), now);
+    }
+
+    fec_next_group(fec_encoder);
+    return status;
+}
+
+int flush_parity(struct networking_options& networkingOptions) {
+    if (fec_encoder.group_size == 0 || fec_encoder.members == 0) {
+        return 0;
+    }
+
+    return queue_parity(networkingOptions, std::chrono::steady_clock::now());
+}
+
+int flush_packets(struct networking_options& networkingOptions) {
+    if (send_packets_over(networkingOptions, outgoing_packets) < 0) {
+        perror("Send Failed");
+        return -1;
+    }
+
+    return 0;
+}
+
+void wait_for_pacer(struct networking_options& networkingOptions) {
+    size_t packet_length = HEADER_LENGTH + 1 + networkingOptions.header->data.length();
+    auto now = std::chrono::steady_clock::now();
+
+    sync_pacer(now);
+    auto release = pacer_release_time(pacer, packet_length, now);
+
+    if (release > now) {
+        pacer_sleep_until(release);
+    }
+}
+
+void wait_for_window(struct networking_options& networkingOptions) {
+    // Announce the wait before the last look, so an acknowledgement landing in between still signals
+    sender_waiting = true;
+    if (!window_has_room(networkingOptions, networkingOptions.header->sequence_number)) {
+        struct pollfd window_event{};
+        window_event.fd = window_event_fd;
+        window_event.events = POLLIN;
+        // Bounded so an interrupt is noticed even if no acknowledgement ever comes
+        poll(&window_event, window_event_fd == -1 ? 0 : 1, WINDOW_WAIT_MS);
+    }
+    sender_waiting = false;
+
+#ifdef __linux__
+    uint64_t signals;
+    if (read(window_event_fd, &signals, sizeof(signals)) < 0 && errno != EAGAIN) {
+        perror("Window eventfd read failed");
+    }
+#endif
+}
+
+void track_new_packets() {
+    uint32_t published = next_sequence_number.load(std::memory_order_acquire);
+    auto rto = rtt_current_rto(rtt_estimator);
+
+    if (tracked_sequence_number == published) {
+        return;
+    }
+
+    for (; tracked_sequence_number != published; ++tracked_sequence_number) {
+        auto& sent_packet = sent_packets[tracked_sequence_number & sent_packets_mask];
+
+        // Arm its retransmission timer
+        sent_packet.in_flight = true;
+        sent_packet.fast_retransmitted = false;
+        sent_packet.timer.sequence_number = tracked_sequence_number;
+        timer_wheel_schedule(retransmission_timers, sent_packet.timer, sent_packet.header.sent_time + rto);
+    }
+
+    // The newest packet is now the tail to probe
+    schedule_tail_probe(sent_packets[(published - 1) & sent_packets_mask].header.sent_time);
+}
+
+void publish_window() {
+    congestion_window_limit = congestion_control->congestion_window();
+
+    // Only costs a write while the sender actually sleeps
+    if (sender_waiting.exchange(false) && window_event_fd != -1) {
+        uint64_t signal = 1;
+        if (write(window_event_fd, &signal, sizeof(signal)) < 0) {
+            perror("Window eventfd write failed");
+        }
+    }
+}
+
+
+uint32_t decode_string(char * packet_raw, ssize_t length, struct acknowledgement& ack) {
 
     // Extract fields from the packet
     uint32_t seq_number;
     uint32_t ack_number;
+    uint8_t flags;
+    uint16_t data_length;
+    size_t offset = HEADER_LENGTH - 2;
 
     std::memcpy(&seq_number, &packet_raw[0], sizeof(seq_number));
     std::memcpy(&ack_number, &packet_raw[4], sizeof(ack_number));
+    std::memcpy(&flags, &packet_raw[8], sizeof(flags));
+    std::memcpy(&data_length, &packet_raw[9], sizeof(data_length));
 
     seq_number = ntohl(seq_number);
     ack_number = ntohl(ack_number);
+    data_length = ntohs(data_length);
+
+    // Never read past what actually arrived
+    size_t end = std::min(static_cast<size_t>(length), offset + data_length);
+
+    ack.ack_number = ack_number;
+    ack.flags = flags;
+    ack.selective = false;
+    ack.block_count = 0;
+
+    // The receiver window follows the header when the receiver advertises one
+    if (offset + sizeof(uint32_t) <= end) {
+        uint32_t window;
+        std::memcpy(&window, &packet_raw[offset], sizeof(window));
+        ack.receiver_window = ntohl(window);
+        offset += sizeof(window);
+    }
+
+    // Then the cumulative ack and the blocks held above it
+    if ((flags & SACK_FLAG) && offset + sizeof(uint32_t) + sizeof(uint8_t) <= end) {
+        uint32_t cumulative_ack;
+        uint8_t block_count;
+        std::memcpy(&cumulative_ack, &packet_raw[offset], sizeof(cumulative_ack));
+        offset += sizeof(cumulative_ack);
+        std::memcpy(&block_count, &packet_raw[offset], sizeof(block_count));
+        offset += sizeof(block_count);
+
+        ack.selective = true;
+        ack.cumulative_ack = ntohl(cumulative_ack);
+
+        for (uint8_t i = 0; i < block_count && i < SACK_MAX_BLOCKS && offset + 2 * sizeof(uint32_t) <= end; ++i) {
+            uint32_t edges[2];
+            std::memcpy(edges, &packet_raw[offset], sizeof(edges));
+            offset += sizeof(edges);
+            ack.blocks[i][0] = ntohl(edges[0]);
+            ack.blocks[i][1] = ntohl(edges[1]);
+            ack.block_count++;
+        }
+    }
 
     std::cout << "----------RECEIVING----------" << std::endl;
 
@@ -161,109 +684,401 @@ uint32_t decode_string(char * packet_raw) {
 }
 
 
+void retransmit_packet(struct networking_options& networkingOptions, struct in_flight_packet& sent_packet,
+                       std::chrono::steady_clock::time_point now, std::chrono::microseconds rto) {
+    if (send_batch_full(retransmitted_packets) && send_packets_over(networkingOptions, retransmitted_packets) < 0) {
+        perror("Retransmission Failed To Send");
+    }
+
+    printf("Retransmitting packet with sequence number %d\n", sent_packet.header.sequence_number);
+    // Retransmit packet, straight from the payload it was first sent from, its first send may still be queued
+    size_t packet_length = add_packet_to_batch(retransmitted_packets, sent_packet, sent_packet.retransmission_bytes);
+    sent_packet.header.sent_time = now;
+    sent_packet.header.transmissions++;
+    // Charged by the sender thread, which owns the pacer
+    retransmitted_bytes += packet_length;
+
+    // Armed before the send so a failed packet is tried again
+    timer_wheel_schedule(retransmission_timers, sent_packet.timer, now + rto);
+}
+
 void check_need_for_retransmission(struct networking_options& networkingOptions) {
-    // Iterate over the elements up to a maximum of the first five
-    for (size_t i = 0; i < std::min(sent_packets.size(), static_cast<size_t>((WINDOW_SIZE + 1))); ++i) {
-        auto& sent_packet = sent_packets[i];
-
-        if (sent_packet.sent_counter >= RETRANSMISSION_COUNT) {
-            printf("Retransmitting packet with sequence number %d\n", sent_packet.sequence_number);
-            // Retransmit packet
-            std::string packet = pack_header(&sent_packet);
-            ssize_t ret_status = send_packet_over(networkingOptions, packet);
-
-            if (ret_status < 0) {
-                perror("Retransmission Failed To Send");
-                return;
-            }
+    auto now = std::chrono::steady_clock::now();
+    struct timer_node * expired = timer_wheel_expire(retransmission_timers, now);
+
+    if (expired == nullptr) {
+        return;
+    }
 
-            sent_packet.sent_counter = 0;
+    // Only the oldest packet stands in for the single RFC 6298 timer, so later packets expiring do not compound the backoff
+    // The timer has taken over recovery, probing again waits for an acknowledgement
+    tail_probe_armed = false;
+
+    for (struct timer_node * node = expired; node != nullptr; node = node->next) {
+        if (node->sequence_number == send_base) {
+            rtt_backoff(rtt_estimator);
+            congestion_control->on_retransmission_timeout(send_base, tracked_sequence_number, now);
+        } else {
+            congestion_control->on_packet_lost(node->sequence_number, tracked_sequence_number, now);
         }
     }
+    auto rto = rtt_current_rto(rtt_estimator);
+
+    while (expired != nullptr) {
+        struct timer_node * next = expired->next;
+        retransmit_packet(networkingOptions, sent_packets[expired->sequence_number & sent_packets_mask], now, rto);
+        expired = next;
+    }
+
+    if (send_packets_over(networkingOptions, retransmitted_packets) < 0) {
+        perror("Retransmission Failed To Send");
+    }
+
+    update_pacing_rate(networkingOptions);
+}
+
+bool fast_retransmit(struct networking_options& networkingOptions, uint32_t sequence_number, std::chrono::steady_clock::time_point now) {
+    auto& sent_packet = sent_packets[sequence_number & sent_packets_mask];
+
+    // A retransmission lost again is left to its timer
+    if (!sent_packet.in_flight || sent_packet.fast_retransmitted) {
+        return false;
+    }
+    sent_packet.fast_retransmitted = true;
+
+    // Fast recovery: the window is cut once for every loss in the window in flight, not collapsed as on a timeout
+    congestion_control->on_packet_lost(sequence_number, tracked_sequence_number, now);
+    retransmit_packet(networkingOptions, sent_packet, now, rtt_current_rto(rtt_estimator));
+    return true;
+}
+
+void detect_lost_packets(struct networking_options& networkingOptions) {
+    auto now = std::chrono::steady_clock::now();
+    uint32_t base = send_base;
+    uint32_t threshold = FAST_RETRANSMIT_THRESHOLD;
+    bool retransmitted = false;
+
+    // Once the tail probe is through, whatever was sent before it and is still missing went down with the tail
+    if (tail_probe_outstanding && static_cast<int32_t>(highest_acknowledged - tail_probe_sequence) >= 0) {
+        threshold = 1;
+    }
+
+    // Repeated cumulative acks point at the oldest packet even when the blocks above it say little
+    if (duplicate_acks >= FAST_RETRANSMIT_THRESHOLD && base != tracked_sequence_number) {
+        retransmitted |= fast_retransmit(networkingOptions, base, now);
+    }
+
+    // Each packet is looked at once, as soon as enough packets sent after it have arrived
+    if (static_cast<int32_t>(loss_scan_cursor - base) < 0) {
+        loss_scan_cursor = base;
+    }
+    while (loss_scan_cursor != tracked_sequence_number &&
+           static_cast<int32_t>(highest_acknowledged - loss_scan_cursor) >= static_cast<int32_t>(threshold)) {
+        retransmitted |= fast_retransmit(networkingOptions, loss_scan_cursor, now);
+        loss_scan_cursor++;
+    }
+
+    if (!retransmitted) {
+        return;
+    }
+
+    if (send_packets_over(networkingOptions, retransmitted_packets) < 0) {
+        perror("Retransmission Failed To Send");
+    }
+
+    update_pacing_rate(networkingOptions);
+}
+
+void schedule_tail_probe(std::chrono::steady_clock::time_point now) {
+    // Without a round trip measured the probe timeout would be a guess, and the retransmission timer already is one
+    if (send_base == tracked_sequence_number || tail_probe_outstanding || !rtt_estimator.has_sample) {
+        tail_probe_armed = false;
+        return;
+    }
+
+    // Two round trips leave room for the receiver's delayed ack, and a probe later than the timer would be pointless
+    auto timeout = std::max<std::chrono::microseconds>(2 * rtt_estimator.srtt, std::chrono::milliseconds(TAIL_PROBE_MIN_MS));
+    tail_probe_deadline = now + std::min(timeout, rtt_current_rto(rtt_estimator));
+    tail_probe_armed = true;
+}
+
+void check_need_for_tail_probe(struct networking_options& networkingOptions) {
+    auto now = std::chrono::steady_clock::now();
+
+    if (!tail_probe_armed || now < tail_probe_deadline) {
+        return;
+    }
+    tail_probe_armed = false;
+
+    if (send_base == tracked_sequence_number) {
+        return;
+    }
+
+    // The newest packet still outstanding, usually the last one sent
+    uint32_t sequence_number = tracked_sequence_number;
+    do {
+        sequence_number--;
+    } while (sequence_number != send_base && !sent_packets[sequence_number & sent_packets_mask].in_flight);
+
+    auto& sent_packet = sent_packets[sequence_number & sent_packets_mask];
+    if (!sent_packet.in_flight) {
+        return;
+    }
+
+    // A probe, not a loss, so the congestion window is left alone
+    tail_probe_outstanding = true;
+    tail_probe_sequence = sequence_number;
+    retransmit_packet(networkingOptions, sent_packet, now, rtt_current_rto(rtt_estimator));
+
+    if (send_packets_over(networkingOptions, retransmitted_packets) < 0) {
+        perror("Retransmission Failed To Send");
+    }
 }
 
-void write_data_to_file(FILE * stats_file, uint32_t sequence_number, time_t time_taken) {
-    // Write the data to the file
-    fprintf(stats_file, "%d, %ld\n", sequence_number, time_taken);
+void sample_round_trip_time(uint32_t ack_number) {
+    // Slots outside the tracked window belong to the sender thread
+    if (ack_number - send_base >= tracked_sequence_number - send_base) {
+        return;
+    }
+
+    auto& sent_packet = sent_packets[ack_number & sent_packets_mask];
+
+    if (!sent_packet.in_flight || sent_packet.header.sequence_number != ack_number) {
+        return;
+    }
 
-    // Flush the file
-    fflush(stats_file);
+    // Karn's rule: an ack for a retransmitted packet is ambiguous, so only time packets sent once
+    if (sent_packet.header.transmissions == 1) {
+        auto sample = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent_packet.header.sent_time);
+        rtt_add_sample(rtt_estimator, sample);
+    }
 }
 
 void remove_packet_from_sent_packets(struct networking_options& networkingOptions, uint32_t ack_number) {
-    for (auto it = sent_packets.begin(); it != sent_packets.end(); ++it) {
-        if (it->sequence_number == ack_number) {
-            // Calculate the time taken
-            time_t time_taken = time(nullptr) - networkingOptions.time_started;
-            write_data_to_file(networkingOptions.stats_file, it->sequence_number, time_taken);
-
-            // Remove the packet from the list of sent packets
-            sent_packets.erase(it); // Update iterator after erasing
-            window_size--;
-            return;
+    uint32_t base = send_base;
+
+    // Slots outside the tracked window belong to the sender thread
+    if (ack_number - base >= tracked_sequence_number - base) {
+        return;
+    }
+
+    auto& sent_packet = sent_packets[ack_number & sent_packets_mask];
+
+    // Duplicate or stale acknowledgement
+    if (!sent_packet.in_flight || sent_packet.header.sequence_number != ack_number) {
+        return;
+    }
+
+    // Calculate the time taken
+    time_t time_taken = time(nullptr) - networkingOptions.time_started;
+    // Queued for the stats thread, no write happens while the ring is locked
+    record_stats(*networkingOptions.stats, sent_packet.header.sequence_number, time_taken);
+
+    // Remove the packet from the list of sent packets
+    timer_wheel_cancel(retransmission_timers, sent_packet.timer);
+    sent_packet.in_flight = false;
+    window_size--;
+    newly_acknowledged++;
+
+    // Anything sent well before it and still outstanding is likely lost
+    if (static_cast<int32_t>(ack_number - highest_acknowledged) > 0) {
+        highest_acknowledged = ack_number;
+    }
+
+    // Slide the window past every acknowledged packet at its front, handing their slots back to the sender thread
+    while (base != tracked_sequence_number && !sent_packets[base & sent_packets_mask].in_flight) {
+        base++;
+    }
+    send_base = base;
+}
+
+void remove_acknowledged_range(struct networking_options& networkingOptions, uint32_t start, uint32_t end) {
+    // Clip the range to what is actually outstanding
+    if (static_cast<int32_t>(start - send_base) < 0) {
+        start = send_base;
+    }
+    if (static_cast<int32_t>(end - tracked_sequence_number) > 0) {
+        end = tracked_sequence_number;
+    }
+
+    for (uint32_t sequence_number = start; static_cast<int32_t>(end - sequence_number) > 0; ++sequence_number) {
+        remove_packet_from_sent_packets(networkingOptions, sequence_number);
+    }
+}
+
+void process_selective_ack(struct networking_options& networkingOptions, const struct acknowledgement& ack) {
+    // Everything below the cumulative ack has been delivered
+    remove_acknowledged_range(networkingOptions, send_base, ack.cumulative_ack);
+
+    // Only walk the parts of each block that earlier acks did not already cover
+    for (uint8_t i = 0; i < ack.block_count; ++i) {
+        uint32_t cursor = ack.blocks[i][0];
+        uint32_t end = ack.blocks[i][1];
+
+        for (uint8_t j = 0; j < processed_sack_block_count; ++j) {
+            uint32_t covered_start = processed_sack_blocks[j][0];
+            uint32_t covered_end = processed_sack_blocks[j][1];
+
+            if (static_cast<int32_t>(covered_end - cursor) <= 0 || static_cast<int32_t>(end - covered_start) <= 0) {
+                continue;
+            }
+            if (static_cast<int32_t>(covered_start - cursor) > 0) {
+                remove_acknowledged_range(networkingOptions, cursor, covered_start);
+            }
+            cursor = covered_end;
+        }
+
+        if (static_cast<int32_t>(end - cursor) > 0) {
+            remove_acknowledged_range(networkingOptions, cursor, end);
         }
     }
+
+    std::memcpy(processed_sack_blocks, ack.blocks, sizeof(ack.blocks[0]) * ack.block_count);
+    processed_sack_block_count = ack.block_count;
 }
 
+void update_pacing_rate(struct networking_options& networkingOptions) {
+    if (!networkingOptions.pacing || networkingOptions.pacing_rate > 0 || !rtt_estimator.has_sample) {
+        return;
+    }
 
-uint32_t receive_acknowledgements(struct networking_options& networkingOptions, int timeout_seconds) {
-    ssize_t ret_status;
+    // Run ahead of the window while it is still doubling so pacing never holds slow start back
+    double gain = congestion_control->in_slow_start() ? PACING_SLOW_START_GAIN : PACING_CONGESTION_AVOIDANCE_GAIN;
+    double window_bytes = static_cast<double>(congestion_control->congestion_window()) * (HEADER_LENGTH + 1 + networkingOptions.payload_length);
+    double srtt_seconds = std::max(std::chrono::duration<double>(rtt_estimator.srtt).count(), 1e-6);
 
-    modifying_global_variables.lock();
+    pending_pacing_rate = gain * window_bytes / srtt_seconds;
+}
+
+
+bool init_ack_receiver(struct networking_options& networkingOptions) {
+    if (!open_ack_events(ack_events, networkingOptions.socket_fd)) {
+        networkingOptions.message = "Failed to create acknowledgement events";
+        return false;
+    }
+
+    return true;
+}
 
-    if (window_size > WINDOW_SIZE) {
-        increment_sent_counter();
+uint32_t packets_outstanding() {
+    return window_size;
+}
+
+void wake_ack_receiver() {
+    // The eventfd keeps the signal, so even a thread just about to sleep returns straight away
+    signal_ack_events(ack_events);
+}
+
+uint32_t process_acknowledgement(struct networking_options& networkingOptions, char * buffer, ssize_t length) {
+    // Decode the acknowledgement
+    struct acknowledgement ack{};
+    ack.receiver_window = networkingOptions.receiver_window_size;
+    uint32_t ack_number = decode_string(buffer, length, ack);
+
+    // A late answer to a path MTU probe, whose number has nothing to do with the data
+    if (ack.flags & PROBE_FLAG) {
+        return 0;
+    }
+
+    networkingOptions.receiver_window_size = std::clamp(ack.receiver_window, static_cast<uint32_t>(1), static_cast<uint32_t>(MAX_WINDOW_SIZE));
+    receiver_window = networkingOptions.receiver_window_size;
+
+    // Time the packet that triggered this ack before anything is removed
+    sample_round_trip_time(ack_number);
+
+    // Remove the packet from the list of sent packets
+    remove_packet_from_sent_packets(networkingOptions, ack_number);
+
+    // A selective ack can clear many more
+    if (ack.selective) {
+        // One that leaves the cumulative ack where it was reports a packet above a gap
+        if (ack.cumulative_ack == last_cumulative_ack && ack.cumulative_ack != tracked_sequence_number) {
+            duplicate_acks++;
+        } else {
+            last_cumulative_ack = ack.cumulative_ack;
+            duplicate_acks = 0;
+        }
+        process_selective_ack(networkingOptions, ack);
     }
 
+    return ack_number;
+}
+
+uint32_t receive_acknowledgements(struct networking_options& networkingOptions, int timeout_seconds) {
+    std::chrono::steady_clock::time_point deadline;
+    int ready = ACK_EVENT_SENDER;
+
     // Check if any packets need to be retransmitted
+    track_new_packets();
     check_need_for_retransmission(networkingOptions);
-    modifying_global_variables.unlock();
-
-    // Set up fd_set for select
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(networkingOptions.socket_fd, &read_fds);
-
-    // Set up timeout using timeval struct
-    struct timeval timeout{};
-    timeout.tv_sec = 0;
-    timeout.tv_usec = timeout_seconds;
-
-    // Use select to wait for data or timeout
-    ret_status = select(networkingOptions.socket_fd + 1, &read_fds, nullptr, nullptr, &timeout);
-
-    if (ret_status == 0) {
-        // Timeout occurred
-        modifying_global_variables.lock();
-        increment_sent_counter();
-        modifying_global_variables.unlock();
-        return 1;
-    } else if (ret_status < 0) {
-        // Error in select
-        perror("Select failed");
+    check_need_for_tail_probe(networkingOptions);
+    publish_window();
+    networkingOptions.current_window_size = congestion_control->congestion_window();
+    networkingOptions.packets_in_flight = window_size;
+
+    // The timerfd wakes the wait at the next retransmission deadline, or the tail loss probe if that comes first
+    bool timer_pending = timer_wheel_next_deadline(retransmission_timers, deadline);
+    if (tail_probe_armed && (!timer_pending || tail_probe_deadline < deadline)) {
+        deadline = tail_probe_deadline;
+        timer_pending = true;
+    }
+    arm_ack_timer(ack_events, timer_pending, deadline);
+
+    // With no timer armed a packet published now would go untimed until the next ack, so ask the sender for a wakeup,
+    // then look once more in case one was published before the request
+    ack_thread_idle = !timer_pending;
+    if (timer_pending || next_sequence_number == tracked_sequence_number) {
+        ready = wait_for_ack_events(ack_events, std::chrono::microseconds(timeout_seconds));
+    }
+    ack_thread_idle = false;
+
+    if (ready < 0) {
+        perror("Epoll wait failed");
         return 0;
     }
 
-    // Receive the acknowledgement
-    char buffer[HEADER_LENGTH];
-    ret_status = recvfrom(networkingOptions.socket_fd, buffer, sizeof(buffer), 0, nullptr, nullptr);
+    if (!(ready & ACK_EVENT_SOCKET)) {
+        // Expired timers and newly sent packets are both picked up at the top of the next pass
+        return 1;
+    }
 
-    if (ret_status < 0) {
+    // Take everything already queued, so a burst of acks costs one wakeup and one window update
+    if (receive_ack_batch(ack_events, incoming_acks) < 0) {
         perror("Receive Failed");
         return 0;
     }
 
-    modifying_global_variables.lock();
+    // Packets sent since the wait began may already be acknowledged
+    track_new_packets();
 
-    // Decode the acknowledgement
-    uint32_t ack_number = decode_string(buffer);
+    uint32_t ack_number = 0;
+    // Counted as packets are released, the sender thread may grow window_size meanwhile
+    newly_acknowledged = 0;
 
-    // Remove the packet from the list of sent packets
-    remove_packet_from_sent_packets(networkingOptions, ack_number);
+    for (size_t i = 0; i < incoming_acks.count; ++i) {
+        // Runt datagram, nothing to acknowledge
+        if (incoming_acks.lengths[i] < HEADER_LENGTH) {
+            continue;
+        }
+        ack_number = process_acknowledgement(networkingOptions, incoming_acks.buffers[i], incoming_acks.lengths[i]);
+    }
+
+    // Resend what the batch shows missing now, rather than a timeout later, and enter recovery before any growth
+    detect_lost_packets(networkingOptions);
 
-    modifying_global_variables.unlock();
+    auto now = std::chrono::steady_clock::now();
+    congestion_control->on_packets_acked(newly_acknowledged, send_base, rtt_estimator.srtt, now);
+
+    // Progress answers any probe, the next one is timed from here
+    if (newly_acknowledged > 0) {
+        tail_probe_outstanding = false;
+        schedule_tail_probe(now);
+    }
+    update_pacing_rate(networkingOptions);
+    publish_window();
+    networkingOptions.current_window_size = congestion_control->congestion_window();
+    networkingOptions.packets_in_flight = window_size;
 
-    // Return the acknowledgement number except for the first packet
-    networkingOptions.current_window_size = window_size;
+    // Return the last acknowledgement number except for the first packet
     return ack_number == 0 ? 1 : ack_number;
 }
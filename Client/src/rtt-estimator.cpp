@@ -0,0 +1,42 @@
+#include "rtt-estimator.hpp"
+#include <algorithm>
+
+void rtt_add_sample(struct rtt_estimator& estimator, std::chrono::microseconds sample) {
+    if (sample.count() <= 0) {
+        sample = std::chrono::microseconds(1);
+    }
+
+    if (!estimator.has_sample) {
+        // First measurement (RFC 6298 2.2)
+        estimator.srtt = sample;
+        estimator.rttvar = sample / 2;
+        estimator.has_sample = true;
+    } else {
+        // Subsequent measurements with alpha = 1/8 and beta = 1/4 (RFC 6298 2.3)
+        std::chrono::microseconds delta = estimator.srtt - sample;
+        if (delta.count() < 0) {
+            delta = -delta;
+        }
+        estimator.rttvar = (3 * estimator.rttvar + delta) / 4;
+        estimator.srtt = (7 * estimator.srtt + sample) / 8;
+    }
+
+    std::chrono::microseconds variance = std::max(std::chrono::microseconds(CLOCK_GRANULARITY_US), 4 * estimator.rttvar);
+    estimator.rto = std::clamp(estimator.srtt + variance,
+                               std::chrono::microseconds(std::chrono::milliseconds(MIN_RTO_MS)),
+                               std::chrono::microseconds(std::chrono::milliseconds(MAX_RTO_MS)));
+
+    // A fresh sample collapses any backoff (RFC 6298 5.7)
+    estimator.backoff = 0;
+}
+
+void rtt_backoff(struct rtt_estimator& estimator) {
+    if (estimator.backoff < MAX_RTO_BACKOFF) {
+        estimator.backoff++;
+    }
+}
+
+std::chrono::microseconds rtt_current_rto(const struct rtt_estimator& estimator) {
+    return std::min(estimator.rto * (1 << estimator.backoff),
+                    std::chrono::microseconds(std::chrono::milliseconds(MAX_RTO_MS)));
+}
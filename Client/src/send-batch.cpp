@@ -0,0 +1,201 @@
+#include "send-batch.hpp"
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#define MAX_GSO_SEGMENTS 64
+#define MAX_GSO_PAYLOAD 65000
+
+/**
+ * @brief Cleared once the kernel or the route turns down segmentation offload
+ */
+static bool gso_supported = true;
+/**
+ * @brief Cleared once the kernel turns down sendmmsg
+ */
+static bool sendmmsg_supported = true;
+
+/**
+ * @brief Send the batch as a single buffer the kernel cuts into equal datagrams
+ * @param batch Send batch struct
+ * @param socket_fd Socket to send on
+ * @param destination Receiver address
+ * @param destination_length Size of the receiver address
+ * @return Number of datagrams sent, 0 if segmentation offload cannot be used, -1 on error
+ */
+static ssize_t send_segmented(struct send_batch& batch, int socket_fd, const struct sockaddr * destination, socklen_t destination_length);
+/**
+ * @brief Send the batch with as few sendmmsg calls as the kernel allows
+ * @param batch Send batch struct
+ * @param socket_fd Socket to send on
+ * @param destination Receiver address
+ * @param destination_length Size of the receiver address
+ * @return Number of datagrams sent, 0 if sendmmsg is unavailable, -1 on error
+ */
+static ssize_t send_multiple(struct send_batch& batch, int socket_fd, const struct sockaddr * destination, socklen_t destination_length);
+/**
+ * @brief Send the batch one datagram at a time
+ * @param batch Send batch struct
+ * @param socket_fd Socket to send on
+ * @param destination Receiver address
+ * @param destination_length Size of the receiver address
+ * @return Number of datagrams sent, -1 if none could be
+ */
+static ssize_t send_each(struct send_batch& batch, int socket_fd, const struct sockaddr * destination, socklen_t destination_length);
+
+bool send_batch_full(const struct send_batch& batch) {
+    return batch.count == SEND_BATCH_SIZE;
+}
+
+void send_batch_add(struct send_batch& batch, const struct iovec * parts, size_t part_count) {
+    size_t length = 0;
+
+    for (size_t i = 0; i < part_count; ++i) {
+        batch.parts[batch.part_total + i] = parts[i];
+        length += parts[i].iov_len;
+    }
+
+    batch.part_counts[batch.count] = part_count;
+    batch.lengths[batch.count] = length;
+    batch.part_total += part_count;
+    batch.count++;
+}
+
+static ssize_t send_segmented(struct send_batch& batch, int socket_fd, const struct sockaddr * destination, socklen_t destination_length) {
+#ifdef UDP_SEGMENT
+    size_t segment_size = batch.lengths[0];
+    size_t total = 0;
+
+    // Every datagram but the last must be exactly one segment long
+    for (size_t i = 0; i < batch.count; ++i) {
+        if ((i + 1 < batch.count && batch.lengths[i] != segment_size) || batch.lengths[i] > segment_size) {
+            return 0;
+        }
+        total += batch.lengths[i];
+    }
+    if (batch.count > MAX_GSO_SEGMENTS || total > MAX_GSO_PAYLOAD) {
+        return 0;
+    }
+
+    char control[CMSG_SPACE(sizeof(uint16_t))] = {};
+    struct msghdr message{};
+    message.msg_name = const_cast<struct sockaddr *>(destination);
+    message.msg_namelen = destination_length;
+    // The parts of every datagram back to back, the kernel cuts them apart again at each segment size
+    message.msg_iov = batch.parts;
+    message.msg_iovlen = batch.part_total;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    struct cmsghdr * header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = IPPROTO_UDP;
+    header->cmsg_type = UDP_SEGMENT;
+    header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    auto gso_size = static_cast<uint16_t>(segment_size);
+    std::memcpy(CMSG_DATA(header), &gso_size, sizeof(gso_size));
+
+    if (sendmsg(socket_fd, &message, 0) >= 0) {
+        return static_cast<ssize_t>(batch.count);
+    }
+
+    // Old kernels, and routes without checksum offload, refuse segmentation outright
+    if (errno == EINVAL || errno == EIO || errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+        gso_supported = false;
+        return 0;
+    }
+    return -1;
+#else
+    (void) batch;
+    (void) socket_fd;
+    (void) destination;
+    (void) destination_length;
+    gso_supported = false;
+    return 0;
+#endif
+}
+
+static ssize_t send_multiple(struct send_batch& batch, int socket_fd, const struct sockaddr * destination, socklen_t destination_length) {
+#ifdef __linux__
+    struct mmsghdr messages[SEND_BATCH_SIZE] = {};
+    size_t first_part = 0;
+
+    for (size_t i = 0; i < batch.count; ++i) {
+        messages[i].msg_hdr.msg_name = const_cast<struct sockaddr *>(destination);
+        messages[i].msg_hdr.msg_namelen = destination_length;
+        messages[i].msg_hdr.msg_iov = &batch.parts[first_part];
+        messages[i].msg_hdr.msg_iovlen = batch.part_counts[i];
+        first_part += batch.part_counts[i];
+    }
+
+    // sendmmsg may stop short, so keep going from wherever it stopped
+    size_t sent = 0;
+    while (sent < batch.count) {
+        int ret_status = sendmmsg(socket_fd, &messages[sent], static_cast<unsigned int>(batch.count - sent), 0);
+
+        if (ret_status < 0) {
+            if (errno == ENOSYS && sent == 0) {
+                sendmmsg_supported = false;
+                return 0;
+            }
+            return sent == 0 ? -1 : static_cast<ssize_t>(sent);
+        }
+        sent += static_cast<size_t>(ret_status);
+    }
+
+    return static_cast<ssize_t>(sent);
+#else
+    (void) batch;
+    (void) socket_fd;
+    (void) destination;
+    (void) destination_length;
+    sendmmsg_supported = false;
+    return 0;
+#endif
+}
+
+static ssize_t send_each(struct send_batch& batch, int socket_fd, const struct sockaddr * destination, socklen_t destination_length) {
+    size_t sent = 0;
+    size_t first_part = 0;
+
+    while (sent < batch.count) {
+        struct msghdr message{};
+        message.msg_name = const_cast<struct sockaddr *>(destination);
+        message.msg_namelen = destination_length;
+        message.msg_iov = &batch.parts[first_part];
+        message.msg_iovlen = batch.part_counts[sent];
+
+        if (sendmsg(socket_fd, &message, 0) < 0) {
+            break;
+        }
+        first_part += batch.part_counts[sent];
+        sent++;
+    }
+
+    return sent == 0 ? -1 : static_cast<ssize_t>(sent);
+}
+
+ssize_t send_batch_flush(struct send_batch& batch, int socket_fd, const struct sockaddr * destination, socklen_t destination_length) {
+    ssize_t sent = 0;
+
+    if (batch.count == 0) {
+        return 0;
+    }
+
+    if (gso_supported && batch.count > 1) {
+        sent = send_segmented(batch, socket_fd, destination, destination_length);
+    }
+    if (sent == 0 && sendmmsg_supported && batch.count > 1) {
+        sent = send_multiple(batch, socket_fd, destination, destination_length);
+    }
+    if (sent == 0) {
+        sent = send_each(batch, socket_fd, destination, destination_length);
+    }
+
+    // Anything left unsent is already in the window and goes out again when its timer expires
+    batch.count = 0;
+    batch.part_total = 0;
+    return sent;
+}
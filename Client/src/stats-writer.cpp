@@ -0,0 +1,130 @@
+#include "stats-writer.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <chrono>
+
+/**
+ * @brief Write every record that is ready, batched into as few writes as the buffer allows
+ * @param writer Stats writer struct
+ * @return Number of records written
+ */
+static size_t drain_stats(struct stats_writer& writer);
+/**
+ * @brief Write a whole buffer, picking up after short writes
+ * @param fd File descriptor
+ * @param buffer Bytes to write
+ * @param length Number of bytes
+ * @return void
+ */
+static void write_all(int fd, const char * buffer, size_t length);
+
+bool open_stats_writer(struct stats_writer& writer, const std::string& path, bool binary) {
+    writer.fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer.fd == -1) {
+        return false;
+    }
+
+    writer.binary = binary;
+    writer.records.resize(STATS_RING_SIZE);
+    writer.head = 0;
+    writer.tail = 0;
+    writer.dropped = 0;
+    writer.running = true;
+    return true;
+}
+
+void start_stats_writer(struct stats_writer& writer) {
+    writer.thread = std::thread([&writer]() {
+        while (writer.running.load(std::memory_order_acquire)) {
+            if (drain_stats(writer) == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(STATS_IDLE_MS));
+            }
+        }
+        drain_stats(writer);
+    });
+}
+
+void record_stats(struct stats_writer& writer, uint32_t sequence_number, time_t time_taken) {
+    // Only the acknowledgement thread records, so the head needs no compare and swap
+    size_t head = writer.head.load(std::memory_order_relaxed);
+
+    if (head - writer.tail.load(std::memory_order_acquire) == STATS_RING_SIZE) {
+        writer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    writer.records[head & (STATS_RING_SIZE - 1)] = {sequence_number, static_cast<int64_t>(time_taken)};
+    writer.head.store(head + 1, std::memory_order_release);
+}
+
+static size_t drain_stats(struct stats_writer& writer) {
+    char buffer[STATS_WRITE_BUFFER_SIZE];
+    size_t length = 0;
+    size_t tail = writer.tail.load(std::memory_order_relaxed);
+    size_t head = writer.head.load(std::memory_order_acquire);
+    size_t drained = head - tail;
+
+    for (; tail != head; ++tail) {
+        const auto& record = writer.records[tail & (STATS_RING_SIZE - 1)];
+
+        if (length + 32 > sizeof(buffer)) {
+            write_all(writer.fd, buffer, length);
+            length = 0;
+        }
+
+        if (writer.binary) {
+            for (size_t i = 0; i < sizeof(uint32_t); ++i) {
+                buffer[length++] = static_cast<char>(record.sequence_number >> (8 * i));
+            }
+            for (size_t i = 0; i < sizeof(int64_t); ++i) {
+                buffer[length++] = static_cast<char>(static_cast<uint64_t>(record.time_taken) >> (8 * i));
+            }
+        } else {
+            length += static_cast<size_t>(std::snprintf(buffer + length, sizeof(buffer) - length, "%" PRIu32 ", %" PRId64 "\n",
+                                                        record.sequence_number, record.time_taken));
+        }
+    }
+
+    // Slots go back to the producer only once their records are formatted
+    writer.tail.store(tail, std::memory_order_release);
+    write_all(writer.fd, buffer, length);
+    return drained;
+}
+
+static void write_all(int fd, const char * buffer, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd, buffer, length);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Failed to write stats");
+            return;
+        }
+        buffer += written;
+        length -= static_cast<size_t>(written);
+    }
+}
+
+void close_stats_writer(struct stats_writer& writer) {
+    if (writer.fd < 0) {
+        return;
+    }
+
+    writer.running.store(false, std::memory_order_release);
+    if (writer.thread.joinable()) {
+        writer.thread.join();
+    } else {
+        drain_stats(writer);
+    }
+
+    if (writer.dropped > 0) {
+        std::fprintf(stderr, "Stats: %zu records dropped\n", writer.dropped.load());
+    }
+    close(writer.fd);
+    writer.fd = -1;
+}
@@ -0,0 +1,245 @@
+#include "timer-wheel.hpp"
+#include <bit>
+#include <algorithm>
+
+/**
+ * @brief Convert a time point to a wheel tick
+ * @param wheel Timer wheel struct
+ * @param time Time point to convert
+ * @param round_up True to round towards the future so a timer never fires early
+ * @return Tick number
+ */
+static uint64_t time_to_tick(const struct timer_wheel& wheel, std::chrono::steady_clock::time_point time, bool round_up);
+/**
+ * @brief Link a timer into the slot matching its expiry relative to the current tick
+ * @param wheel Timer wheel struct
+ * @param node Timer to link
+ * @return void
+ */
+static void place_timer(struct timer_wheel& wheel, struct timer_node& node);
+/**
+ * @brief Unlink a timer from its slot
+ * @param wheel Timer wheel struct
+ * @param node Timer to unlink
+ * @return void
+ */
+static void unlink_timer(struct timer_wheel& wheel, struct timer_node& node);
+/**
+ * @brief Re-place every timer of a higher level slot now that its range is within reach
+ * @param wheel Timer wheel struct
+ * @param level Level of the slot
+ * @param slot Slot index
+ * @return void
+ */
+static void cascade_slot(struct timer_wheel& wheel, int level, unsigned slot);
+/**
+ * @brief Find the first occupied slot of a level, scanning circularly after the given slot
+ * @param wheel Timer wheel struct
+ * @param level Level to scan
+ * @param after Slot to start after
+ * @return Circular distance to the first occupied slot, 0 if the level is empty
+ */
+static unsigned find_occupied_slot(const struct timer_wheel& wheel, int level, unsigned after);
+
+static uint64_t time_to_tick(const struct timer_wheel& wheel, std::chrono::steady_clock::time_point time, bool round_up) {
+    if (time <= wheel.origin) {
+        return 0;
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(time - wheel.origin).count();
+    auto ticks = static_cast<uint64_t>(elapsed) / TIMER_WHEEL_TICK_US;
+
+    if (round_up && static_cast<uint64_t>(elapsed) % TIMER_WHEEL_TICK_US != 0) {
+        ticks++;
+    }
+
+    return ticks;
+}
+
+static void place_timer(struct timer_wheel& wheel, struct timer_node& node) {
+    int level = 0;
+    uint64_t position = node.expires;
+
+    // Pick the lowest level whose range still covers the expiry
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+           (node.expires >> (level * TIMER_WHEEL_LEVEL_BITS)) - (wheel.current_tick >> (level * TIMER_WHEEL_LEVEL_BITS)) >= TIMER_WHEEL_SLOTS) {
+        level++;
+    }
+
+    int shift = level * TIMER_WHEEL_LEVEL_BITS;
+    position >>= shift;
+
+    // Park anything beyond the top level in its furthest slot, it is re-placed when that slot cascades
+    if (position - (wheel.current_tick >> shift) >= TIMER_WHEEL_SLOTS) {
+        position = (wheel.current_tick >> shift) + TIMER_WHEEL_SLOTS - 1;
+    }
+
+    auto slot = static_cast<unsigned>(position & TIMER_WHEEL_SLOT_MASK);
+    struct timer_node ** head = &wheel.slots[level][slot];
+
+    node.level = static_cast<uint8_t>(level);
+    node.slot = static_cast<uint8_t>(slot);
+    node.next = *head;
+    node.pprev = head;
+    if (node.next != nullptr) {
+        node.next->pprev = &node.next;
+    }
+    *head = &node;
+
+    wheel.occupied[level][slot / 64] |= uint64_t(1) << (slot % 64);
+}
+
+static void unlink_timer(struct timer_wheel& wheel, struct timer_node& node) {
+    *node.pprev = node.next;
+    if (node.next != nullptr) {
+        node.next->pprev = node.pprev;
+    }
+
+    if (wheel.slots[node.level][node.slot] == nullptr) {
+        wheel.occupied[node.level][node.slot / 64] &= ~(uint64_t(1) << (node.slot % 64));
+    }
+
+    node.next = nullptr;
+    node.pprev = nullptr;
+}
+
+static void cascade_slot(struct timer_wheel& wheel, int level, unsigned slot) {
+    struct timer_node * node = wheel.slots[level][slot];
+
+    wheel.slots[level][slot] = nullptr;
+    wheel.occupied[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+
+    while (node != nullptr) {
+        struct timer_node * next = node->next;
+        place_timer(wheel, *node);
+        node = next;
+    }
+}
+
+static unsigned find_occupied_slot(const struct timer_wheel& wheel, int level, unsigned after) {
+    const uint64_t * bits = wheel.occupied[level];
+
+    // Check every slot after the cursor, wrapping around to the cursor itself last
+    for (unsigned distance = 1; distance <= TIMER_WHEEL_SLOTS; ) {
+        unsigned slot = (after + distance) & TIMER_WHEEL_SLOT_MASK;
+        uint64_t word = bits[slot / 64] >> (slot % 64);
+
+        if (word != 0) {
+            unsigned found = distance + static_cast<unsigned>(std::countr_zero(word));
+            return found <= TIMER_WHEEL_SLOTS ? found : 0;
+        }
+
+        distance += 64 - (slot % 64);
+    }
+
+    return 0;
+}
+
+void timer_wheel_schedule(struct timer_wheel& wheel, struct timer_node& node, std::chrono::steady_clock::time_point deadline) {
+    timer_wheel_cancel(wheel, node);
+
+    node.expires = std::max(time_to_tick(wheel, deadline, true), wheel.current_tick + 1);
+    node.armed = true;
+    place_timer(wheel, node);
+    wheel.count++;
+}
+
+void timer_wheel_cancel(struct timer_wheel& wheel, struct timer_node& node) {
+    if (!node.armed) {
+        return;
+    }
+
+    unlink_timer(wheel, node);
+    node.armed = false;
+    wheel.count--;
+}
+
+struct timer_node * timer_wheel_expire(struct timer_wheel& wheel, std::chrono::steady_clock::time_point now) {
+    uint64_t now_tick = time_to_tick(wheel, now, false);
+    struct timer_node * expired = nullptr;
+
+    while (wheel.current_tick < now_tick) {
+        if (wheel.count == 0) {
+            wheel.current_tick = now_tick;
+            break;
+        }
+
+        // Skip straight to the next occupied slot within this rotation of the lowest level
+        uint64_t rotation_end = wheel.current_tick | TIMER_WHEEL_SLOT_MASK;
+        uint64_t limit = std::min(now_tick, rotation_end);
+        auto cursor = static_cast<unsigned>(wheel.current_tick & TIMER_WHEEL_SLOT_MASK);
+        unsigned distance = find_occupied_slot(wheel, 0, cursor);
+
+        if (distance != 0 && wheel.current_tick + distance <= limit) {
+            wheel.current_tick += distance - 1;
+        } else if (limit == now_tick) {
+            wheel.current_tick = now_tick;
+            break;
+        } else {
+            wheel.current_tick = rotation_end;
+        }
+
+        wheel.current_tick++;
+
+        // Crossing a rotation boundary pulls the next slot of each higher level down, highest first
+        if ((wheel.current_tick & TIMER_WHEEL_SLOT_MASK) == 0) {
+            int top = 1;
+            while (top < TIMER_WHEEL_LEVELS - 1 && ((wheel.current_tick >> (top * TIMER_WHEEL_LEVEL_BITS)) & TIMER_WHEEL_SLOT_MASK) == 0) {
+                top++;
+            }
+            for (int level = top; level >= 1; --level) {
+                cascade_slot(wheel, level, static_cast<unsigned>((wheel.current_tick >> (level * TIMER_WHEEL_LEVEL_BITS)) & TIMER_WHEEL_SLOT_MASK));
+            }
+        }
+
+        // Everything left in the current lowest level slot expires on this tick
+        auto slot = static_cast<unsigned>(wheel.current_tick & TIMER_WHEEL_SLOT_MASK);
+        while (wheel.slots[0][slot] != nullptr) {
+            struct timer_node * node = wheel.slots[0][slot];
+            unlink_timer(wheel, *node);
+            node->armed = false;
+            wheel.count--;
+            node->next = expired;
+            expired = node;
+        }
+    }
+
+    return expired;
+}
+
+bool timer_wheel_next_deadline(const struct timer_wheel& wheel, std::chrono::steady_clock::time_point& deadline) {
+    if (wheel.count == 0) {
+        return false;
+    }
+
+    uint64_t earliest = UINT64_MAX;
+
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; ++level) {
+        int shift = level * TIMER_WHEEL_LEVEL_BITS;
+        auto cursor = static_cast<unsigned>((wheel.current_tick >> shift) & TIMER_WHEEL_SLOT_MASK);
+        unsigned distance = find_occupied_slot(wheel, level, cursor);
+
+        if (distance == 0) {
+            continue;
+        }
+
+        if (level == 0) {
+            // Lowest level slots map to exactly one tick
+            earliest = std::min(earliest, wheel.current_tick + distance);
+            continue;
+        }
+
+        // Higher level slots span many ticks, so walk the nearest one. The top level can hold timers
+        // parked beyond the wheel's range out of order, so every slot there is walked instead.
+        unsigned last = level == TIMER_WHEEL_LEVELS - 1 ? TIMER_WHEEL_SLOTS : distance;
+        for (unsigned step = distance; step <= last; ++step) {
+            unsigned slot = (cursor + step) & TIMER_WHEEL_SLOT_MASK;
+            for (struct timer_node * node = wheel.slots[level][slot]; node != nullptr; node = node->next) {
+                earliest = std::min(earliest, node->expires);
+            }
+        }
+    }
+
+    deadline = wheel.origin + std::chrono::microseconds(earliest * TIMER_WHEEL_TICK_US);
+    return true;
+}
@@ -1,51 +1,75 @@
 #include <iostream>
-#include <chrono>
-#include <thread>
+#include <atomic>
+#include <poll.h>
+#include <unistd.h>
 #include "reliable-udp.hpp"
 #include "networking.hpp"
 #include "transfer.hpp"
+#include "rtt-estimator.hpp"
+#include "input-reader.hpp"
 
 /**
- * @brief Boolean to check if a file has been sent entirely
+ * @brief Boolean to check if a file has been sent entirely, set once the last packet is in the window
  */
-bool sent_file = false;
+std::atomic<bool> sent_file = false;
+
 /**
- * @brief Last acknowledgement number received
+ * @brief Check whether more input can be read without waiting
+ * @param networkingOptions Networking options struct
+ * @return True if the next payload is ready right now
  */
-uint32_t last_ack = 0;
+static bool input_ready(struct networking_options& networkingOptions);
+
+static bool input_ready(struct networking_options& networkingOptions) {
+    if (!networkingOptions.terminal_input) {
+        return input_pending(*networkingOptions.input, networkingOptions.payload_length);
+    }
+
+    struct pollfd input{};
+    input.fd = STDIN_FILENO;
+    input.events = POLLIN;
+
+    return poll(&input, 1, 0) > 0;
+}
 
 void send_input(struct networking_options& networkingOptions, volatile int& exit_flag) {
-    while (!exit_flag) {
-        std::string input;
+    bool reached_end = false;
+
+    std::string input;
 
-        // Read up to 1010 bytes or until Enter is pressed
-        for (int i = 0; i < MAX_PACKET_LENGTH; ++i) {
-            int ch = std::cin.get();
+    while (!exit_flag && !reached_end) {
+        if (networkingOptions.terminal_input) {
+            input.clear();
+
+            // Read up to a full payload or until Enter is pressed
+            for (size_t i = 0; i < networkingOptions.payload_length; ++i) {
+                int ch = std::cin.get();
 
-            if (networkingOptions.terminal_input) {
                 if (ch == '\n') {
                     // Enter key pressed, break the loop
                     break;
                 }
                 input.push_back(static_cast<char>(ch));
-            } else {
-                if (ch == EOF) {
-                    // End of file reached
-                    sent_file = true;
-                    last_ack = networkingOptions.header->sequence_number;
-                    break;
-                }
-                input.push_back(static_cast<char>(ch));
             }
-        }
 
-        if (input.empty()) {
-            continue;
+            if (input.empty()) {
+                continue;
+            }
+            // Set the data field in the header to the input, send_packet keeps its own copy
+            networkingOptions.header->data = input;
+            printf("Sending: %.*s\n", static_cast<int>(networkingOptions.header->data.length()), networkingOptions.header->data.data());
+        } else {
+            // Slice the payload straight out of the mapped file or the block buffer, not echoed since it may be binary
+            networkingOptions.header->data = next_payload(*networkingOptions.input, networkingOptions.payload_length);
+
+            if (networkingOptions.header->data.empty()) {
+                // End of file reached
+                reached_end = true;
+                continue;
+            }
         }
-        printf("Sending: %s\n", input.c_str());
-        // Set the data field in the header to the input
+
         networkingOptions.header->sequence_number++;
-        networkingOptions.header->data = input;
 
         if (exit_flag) {
             return;
@@ -60,7 +84,33 @@ void send_input(struct networking_options& networkingOptions, volatile int& exit
             if (ret_status == -1) {
                 std::cerr << "Failed to Send." << std::endl;
             }
+            if (ret_status == 1) {
+                wait_for_window(networkingOptions);
+            }
+            if (ret_status == 2) {
+                wait_for_pacer(networkingOptions);
+            }
         }
+
+        // Hand the queued batch to the kernel before a read that could block
+        if (!input_ready(networkingOptions) && flush_packets(networkingOptions) == -1) {
+            std::cerr << "Failed to Send." << std::endl;
+        }
+    }
+
+    // A group cut short by the end of the input still gets its parity
+    if (reached_end && flush_parity(networkingOptions) == -1) {
+        std::cerr << "Failed to Send." << std::endl;
+    }
+
+    if (flush_packets(networkingOptions) == -1) {
+        std::cerr << "Failed to Send." << std::endl;
+    }
+
+    if (reached_end) {
+        sent_file = true;
+        // The last acknowledgement may already be in, leaving the acknowledgement thread asleep with nothing to wait for
+        wake_ack_receiver();
     }
 }
 
@@ -70,21 +120,23 @@ void send_input(struct networking_options& networkingOptions, volatile int& exit
 
 void read_response(struct networking_options& networkingOptions, volatile int& exit_flag) {
     while (!exit_flag) {
+        // Read before the window is checked, so the last packet can never be missed
+        bool file_done = sent_file;
+
+        // Checked before waiting again, the pass that took the last acknowledgement has nothing left to wake it
+        if (file_done && packets_outstanding() == 0) {
+            std::cout << "File Sent Successfully." << std::endl;
+            exit_flag = true;
+            break;
+        }
+
         // Call receive_acknowledgements
-        uint32_t ack_number = receive_acknowledgements(networkingOptions, 10);
+        // Acks, the retransmission timer and the sender all cut the wait short, this only bounds a completely quiet link
+        uint32_t ack_number = receive_acknowledgements(networkingOptions, MIN_RTO_MS * 1000);
 
         if (ack_number == 0) {
             std::cerr << "Failed to Receive Acknowledgement." << std::endl;
             break;
         }
-
-        if (sent_file && (ack_number == last_ack) && (networkingOptions.current_window_size == 0)) {
-            std::cout << "File Sent Successfully." << std::endl;
-            exit_flag = true;
-        }
-
-        // Sleep for a certain duration before rechecking for acknowledgments
-        std::chrono::milliseconds sleep_duration(100);
-        std::this_thread::sleep_for(sleep_duration);
     }
 }
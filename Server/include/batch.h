@@ -0,0 +1,55 @@
+#ifndef RELIABLE_UDP_BATCH_H
+#define RELIABLE_UDP_BATCH_H
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "server.h"
+
+#define RECV_BATCH_SIZE 32
+#define ACK_BATCH_SIZE 64
+#define GRO_BUF_LEN 65536
+
+#ifndef __linux__
+struct mmsghdr {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+
+struct recv_batch {
+    int gro;                // 1 when the kernel may hand over several coalesced datagrams per message
+    size_t buf_len;         // size of each message buffer
+    char *buffers;          // RECV_BATCH_SIZE buffers of buf_len bytes, only when coalescing
+    struct buffer_pool *pool;
+    uint32_t bufs[RECV_BATCH_SIZE]; // pool buffers received into directly otherwise
+    struct mmsghdr msgs[RECV_BATCH_SIZE];
+    struct iovec iovecs[RECV_BATCH_SIZE];
+    struct sockaddr_storage addrs[RECV_BATCH_SIZE];
+    char control[RECV_BATCH_SIZE][CMSG_SPACE(sizeof(int))];
+};
+
+struct ack_batch {
+    int sock_fd;
+    unsigned int count;
+    struct mmsghdr msgs[ACK_BATCH_SIZE];
+    struct iovec iovecs[ACK_BATCH_SIZE];
+    struct sockaddr_storage addrs[ACK_BATCH_SIZE];
+    char acks[ACK_BATCH_SIZE][MAX_ACK_SIZE];
+};
+
+int init_batches(struct server_opts *opts);
+void free_batches(struct server_opts *opts);
+int receive_batch(int sock_fd, struct recv_batch *batch);
+char *batch_buffer(const struct recv_batch *batch, int index);
+uint32_t batch_pool_buffer(const struct recv_batch *batch, int index);
+int replace_batch_buffer(struct recv_batch *batch, int index);
+int grow_batch_buffers(struct recv_batch *batch, size_t len);
+size_t batch_segment_size(const struct recv_batch *batch, int index);
+char *next_ack(struct ack_batch *acks, const struct sockaddr *to_addr, socklen_t to_addr_len);
+void commit_ack(struct ack_batch *acks, size_t ack_len);
+void flush_acks(struct ack_batch *acks);
+
+#endif
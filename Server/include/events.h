@@ -0,0 +1,25 @@
+#ifndef RELIABLE_UDP_EVENTS_H
+#define RELIABLE_UDP_EVENTS_H
+
+#include <stdint.h>
+
+#include "server.h"
+
+#define EVENT_READABLE 1
+#define EVENT_SIGNAL 2
+#define EVENT_TIMER 4
+#define EVENT_STOP 8
+
+#define MAX_BUSY_POLL_US 100000
+#define MIN_BUSY_POLL_US 1
+
+int parse_busy_poll(struct server_opts *opts, const char *arg);
+int init_events(struct server_opts *opts);
+void close_events(struct server_opts *opts);
+int wait_for_events(struct server_opts *opts);
+int signal_pending(struct server_opts *opts);
+int arm_event_timer(struct server_opts *opts, uint64_t usec);
+void arm_next_timer(struct server_opts *opts);
+uint64_t monotonic_usec(void);
+
+#endif
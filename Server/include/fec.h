@@ -0,0 +1,38 @@
+#ifndef RELIABLE_UDP_FEC_H
+#define RELIABLE_UDP_FEC_H
+
+#include <stdint.h>
+
+#include "server.h"
+
+#define FEC_MAX_GROUP 64        // data packets a group spans, one received bit each
+#define FEC_MAX_PARITY 8        // parity packets per group, parity j covers every member i with i % parity_count == j
+#define FEC_MAX_GROUPS 256      // groups tracked at once, a loss in an older one waits for the retransmission
+#define FEC_ALIGN 64            // parity rows start on cache lines so the xor loop runs on whole vectors
+
+struct fec_group {
+    int in_use;
+    uint32_t group;                     // first sequence number / group size
+    uint32_t members;                   // data packets in the group, 0 until a parity packet says
+    uint64_t received;                  // one bit per member folded into its row
+    uint8_t parity_seen;                // one bit per parity packet folded into its row
+    uint16_t len_xor[FEC_MAX_PARITY];   // data_len fields folded together, a row's leftover is the missing length
+};
+
+struct fec_decoder {
+    uint32_t group_size;
+    uint32_t parity_count;
+    uint32_t mask;              // group slot count - 1, the slot count is a power of two
+    size_t stride;              // bytes per row, the payload size rounded up to FEC_ALIGN
+    struct fec_group *groups;
+    uint8_t *rows;              // parity_count rows per group slot, each the xor of everything folded in so far
+    char *scratch;              // a rebuilt packet, laid out as it would have arrived
+};
+
+void fec_record_packet(struct server_opts *opts, struct session *session, const struct packet *pkt, size_t len,
+                       struct sockaddr *from_addr, socklen_t *from_addr_len);
+void fec_receive_parity(struct server_opts *opts, struct session *session, const struct packet *pkt, size_t len,
+                        struct sockaddr *from_addr, socklen_t *from_addr_len);
+void free_fec_decoder(struct fec_decoder *fec);
+
+#endif
@@ -10,7 +10,9 @@
 #include <stdint.h>
 #include <time.h>
 
-void write_to_graph(FILE *graph, uint32_t ack_num, time_t start_time);
+struct stat_writer;
+
+void write_to_graph(struct stat_writer *graph, uint32_t ack_num, time_t start_time);
 void write_to_stat(FILE *stat, uint32_t server_seq_num, uint32_t client_seq_num);
 
 #endif //RELIABLE_UDP_HELPERS_H
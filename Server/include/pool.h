@@ -0,0 +1,30 @@
+#ifndef RELIABLE_UDP_POOL_H
+#define RELIABLE_UDP_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "server.h"
+
+#define POOL_SLAB_SHIFT 8
+#define POOL_SLAB_SIZE (1u << POOL_SLAB_SHIFT)  // buffers added at a time
+#define POOL_BUF_LEN MAX_LEN     // starting buffer size, raised when a sender probes for larger datagrams
+#define POOL_NONE UINT32_MAX
+
+struct buffer_pool {
+    char **slabs;           // each slab is POOL_SLAB_SIZE buffers of the size it was allocated with
+    size_t *slab_buf_lens;  // buffer size of each slab
+    size_t slab_count;
+    size_t buf_len;         // size of every buffer handed out from now on
+    uint32_t *free_list;    // stack of free buffer indexes
+    size_t free_count;
+};
+
+int init_buffer_pool(struct server_opts *opts);
+uint32_t pool_acquire(struct buffer_pool *pool);
+void pool_release(struct buffer_pool *pool, uint32_t index);
+char *pool_buffer(const struct buffer_pool *pool, uint32_t index);
+int resize_buffer_pool(struct buffer_pool *pool, size_t len);
+void free_buffer_pool(struct server_opts *opts);
+
+#endif
@@ -15,46 +15,104 @@
 #include <sys/fcntl.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
 
 #include "fsm.h"
 #include "helpers.h"
 
-#define SERVER_ARGS 3
-#define GRAPH_ARGS 4
-#define IP_INDEX 1
-#define PORT_INDEX 2
-#define GRAPH_INDEX 3
+#define SERVER_ARGS 2
+#define IP_INDEX 0
+#define PORT_INDEX 1
 #define MAX_LEN 1024
-#define WIN_SIZE 5
-#define ACK_SIZE 13
-#define ACK_DATA_LEN 2
+#define MAX_DATAGRAM_LEN 9216    // largest datagram the receive buffers grow to, jumbo frames included
+#define HEADER_LEN 11
+#define FLAGS_OFFSET 8
+#define TRAILER_LEN 3
+#define DEFAULT_WIN_SIZE 5
+#define MAX_WIN_SIZE 65536
+#define DEFAULT_ACK_EVERY 2     // in-order packets covered by one ack
+#define MAX_ACK_EVERY 64
+#define ACK_DELAY_US 1000       // longest an in-order packet waits for its ack
+#define ACK_SIZE 17
+#define ACK_DATA_LEN 6
+#define SACK_MAX_BLOCKS 8
+#define SACK_BLOCK_SIZE 8
+#define MAX_ACK_SIZE (ACK_SIZE + 5 + SACK_MAX_BLOCKS * SACK_BLOCK_SIZE)
 
 #define ACK 1
+#define SACK 2
+#define PROBE 4   // path MTU probe, padding only, answered but never delivered
+#define FEC 8     // parity over a group of data packets, never acked or delivered itself
+
+struct recv_batch;
+struct ack_batch;
+struct session;
+struct session_table;
+struct buffer_pool;
+struct reorder_window;
+struct delivery_sink;
+struct stat_writer;
+
+extern atomic_int exit_flag;   // set by the main thread, read by every worker
 
 struct stash {
-    int cleared; // 0 = cleared, 1 = not cleared
-    uint32_t rel_num;
     uint32_t seq_num;
-    char *data;
+    uint32_t buf;       // pool buffer holding the payload, owned while data is set
+    uint16_t data_len;
+    char *data;         // payload inside the pool buffer
+};
+
+struct sack_block {
+    uint32_t start; // first sequence number held
+    uint32_t end;   // one past the last sequence number held
 };
 
 struct server_opts
 {
     int running; //1 is running w/o graph, 2 is running w graph
+    int graph;
+    int gro;
     int argc;
     int ip_family;
     int sock_fd;
+    int epoll_fd;
+    int signal_fd;
+    int timer_fd;
+    int stop_fd;
+    int sink_type;
+    int sink_fd;
+    int stat_format;
     pid_t graph_pid;
-    FILE *graph_fd;
+    sigset_t saved_sigmask;     //mask from before the signals were blocked, the graph program gets it back
+    struct stat_writer *graph_stats;
     FILE *stat_fd;
     in_port_t host_port;
-    uint32_t client_seq_num;
-    uint32_t server_seq_num;
+    uint32_t win_size;
+    uint32_t workers;
+    uint32_t worker_id;     //0 is the main thread
+    uint32_t total_client_seq_num;
+    uint32_t total_server_seq_num;
+    uint32_t busy_poll_max; //longest spin in microseconds before blocking, 0 never spins
+    uint32_t busy_poll;     //current spin, adapted to how often traffic shows up during it
+    uint32_t ack_every;     //in-order packets acked together, 1 acks every packet
+    uint64_t ack_deadline;  //monotonic usec by which every delayed ack goes out, 0 when none are owed
+    uint64_t sweep_deadline;    //monotonic usec of the next idle session sweep
+    uint64_t timer_deadline;    //what the timer is armed for, so it is only rearmed when that changes
     time_t start_time;
     char *msg;
     char *host_ip;
+    char *sink_path;
     char **argv;
-    struct stash window[WIN_SIZE];
+    struct session_table *sessions;
+    struct buffer_pool *pool;
+    struct delivery_sink *sink;
+    struct recv_batch *rx_batch;
+    struct ack_batch *ack_batch;
+    pthread_t *threads;
+    struct server_opts *worker_opts;
 };
 
 struct packet_header {
@@ -66,29 +124,40 @@ struct packet_header {
 
 struct packet {
     struct packet_header *header;
-    char *data;
+    char *data;         // points into the received datagram, not terminated
+    size_t data_len;    // payload bytes before the terminator
 };
 
 int get_ip_family(const char *ip_addr);
 int parse_in_port_t(struct server_opts *opts);
-void init_window(struct server_opts *opts);
-void init_graphing(struct server_opts *opts);
+int parse_win_size(struct server_opts *opts, const char *arg);
+int parse_ack_every(struct server_opts *opts, const char *arg);
+int init_graphing(struct server_opts *opts);
+int open_socket(struct server_opts *opts);
 int set_socket_non_block(struct server_opts *opts);
-int fill_buffer(int sock_fd, char *buffer,  struct sockaddr *from_addr, socklen_t *from_addr_len);
-void deserialize_packet(char *header, struct packet *pkt);
-void handle_data_in(struct server_opts *opts, char *buffer, uint32_t *client_seq_num, uint32_t *server_seq_num
-        , struct stash *window, struct sockaddr *from_addr, socklen_t *from_addr_len);
-void free_pkt(struct packet *pkt);
-void return_ack(int sock_fd, uint32_t *server_seq_num, uint32_t pkt_seq_num,
-                struct sockaddr *from_addr, const socklen_t *from_addr_len);
-void generate_ack(char *ack, uint32_t server_seq_num, uint32_t pkt_seq_num, uint8_t flags, uint16_t data_len);
-void manage_window(uint32_t *client_seq_num, struct stash *window, struct packet *pkt);
-void deliver_data(char *data, uint32_t seq_num);
-void reset_stash(struct stash *stash);
-void order_window(const uint32_t *client_seq_num, struct stash *window);
-void check_window(uint32_t *client_seq_num, struct stash *window);
-void copy_stash(const struct stash *src, struct stash *dest);
+void size_receive_buffer(struct server_opts *opts, size_t datagram_len);
+int read_batch(struct server_opts *opts);
+void deserialize_packet(char *header, size_t len, struct packet *pkt);
+int handle_data_in(struct server_opts *opts, struct session *session, char *buffer, size_t len, uint32_t buf,
+                   struct sockaddr *from_addr, socklen_t *from_addr_len);
+int accept_packet(struct server_opts *opts, struct session *session, struct packet *pkt, size_t len, uint32_t buf,
+                  struct sockaddr *from_addr, socklen_t *from_addr_len);
+void return_probe_ack(struct ack_batch *acks, uint32_t *server_seq_num, uint32_t probe_seq_num,
+                      const struct reorder_window *window, struct sockaddr *from_addr, const socklen_t *from_addr_len);
+void delay_ack(struct server_opts *opts, struct session *session, uint32_t pkt_seq_num, struct sockaddr *from_addr,
+               socklen_t *from_addr_len);
+void return_ack(struct ack_batch *acks, uint32_t *server_seq_num, uint32_t pkt_seq_num, uint32_t client_seq_num,
+                const struct reorder_window *window, struct sockaddr *from_addr, const socklen_t *from_addr_len);
+size_t generate_ack(char *ack, uint32_t server_seq_num, uint32_t pkt_seq_num, uint8_t flags, uint32_t win_size,
+                    uint32_t cum_ack, const struct sack_block *blocks, uint8_t block_count);
+uint8_t collect_sack_blocks(uint32_t client_seq_num, const struct reorder_window *window, struct sack_block *blocks);
+int manage_window(struct buffer_pool *pool, struct delivery_sink *sink, uint32_t *client_seq_num,
+                  struct reorder_window *window, struct packet *pkt, uint32_t buf);
+int place_packet(struct delivery_sink *sink, uint32_t *client_seq_num, struct reorder_window *window,
+                 const struct packet *pkt, uint32_t block_len);
+void reset_stash(struct buffer_pool *pool, struct stash *stash);
+void check_window(struct delivery_sink *sink, uint32_t *client_seq_num, struct reorder_window *window);
 void print_packet(struct packet *pkt);
-void print_window(struct stash *window);
+void print_window(const struct reorder_window *window, uint32_t client_seq_num);
 
 #endif
@@ -0,0 +1,47 @@
+#ifndef RELIABLE_UDP_SESSION_H
+#define RELIABLE_UDP_SESSION_H
+
+#include <stdint.h>
+#include <time.h>
+
+#include "server.h"
+
+#define SESSION_TABLE_SIZE 256      // initial slot count, always a power of two
+#define SESSION_KEY_LEN 18          // IPv6 address and port
+#define SESSION_IDLE_TIMEOUT 30     // seconds without a packet before a session gives up its window, not its sequence numbers
+#define SESSION_EXPIRE_TIMEOUT 600  // seconds without a packet before the session itself is removed
+#define SESSION_SWEEP_INTERVAL 5    // seconds between idle sweeps
+
+struct session {
+    int in_use;
+    uint8_t key_len;
+    uint8_t key[SESSION_KEY_LEN];
+    uint32_t hash;
+    struct sockaddr_storage peer;
+    uint32_t client_seq_num;
+    uint32_t server_seq_num;
+    struct reorder_window *window;  // NULL while idle, allocated again by the next packet
+    struct fec_decoder *fec;    // parity rows, NULL until the sender's first parity packet
+    uint32_t payload_len;   // payload bytes per packet the sender settled on after probing the path
+    uint32_t acks_owed;     // in-order packets received since the last ack
+    uint32_t owed_seq_num;  // newest of them, echoed by the delayed ack
+    time_t last_seen;
+    uint64_t packets_received;
+    uint64_t bytes_received;
+};
+
+struct session_table {
+    struct session *slots;
+    size_t capacity;
+    size_t count;
+    uint32_t win_size;
+    int hold_packets;   // 0 when payloads go straight to the file and only completion is tracked
+};
+
+int init_sessions(struct server_opts *opts);
+struct session *find_session(struct session_table *table, const struct sockaddr *addr, socklen_t addr_len);
+void evict_idle_sessions(struct server_opts *opts, time_t now);
+void send_delayed_acks(struct server_opts *opts);
+void free_sessions(struct server_opts *opts);
+
+#endif
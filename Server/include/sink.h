@@ -0,0 +1,40 @@
+#ifndef RELIABLE_UDP_SINK_H
+#define RELIABLE_UDP_SINK_H
+
+#include <sys/uio.h>
+#include <stdint.h>
+
+#include "server.h"
+
+#define SINK_PRINT 0    // "Client <seq>: <payload>" lines on stdout
+#define SINK_STDOUT 1   // raw payload bytes on stdout, status messages move to stderr
+#define SINK_FILE 2     // raw payload bytes into a file
+#define SINK_DISCARD 3  // dropped, for benchmarks
+#define SINK_POSITIONAL 4   // payloads written at their file offset as they arrive, in any order
+
+#define FILE_BLOCK_LEN 1010             // payload bytes in every packet of a file transfer but the last, unless probing settles on more
+#define FILE_PREALLOC_LEN (64 << 20)    // bytes reserved ahead of the furthest write
+
+#define SINK_BATCH_SIZE 64
+
+struct delivery_sink {
+    int type;
+    int fd;
+    struct buffer_pool *pool;
+    unsigned int count;
+    struct iovec iovecs[SINK_BATCH_SIZE];
+    uint32_t bufs[SINK_BATCH_SIZE];     // pool buffers held until their bytes are written
+    off_t reserved;                     // end of the space fallocate'd for positional writes, -1 if unsupported
+};
+
+int parse_sink(struct server_opts *opts, const char *arg);
+int parse_receive_file(struct server_opts *opts, const char *arg);
+int open_sink_output(struct server_opts *opts);
+void close_sink_output(struct server_opts *opts);
+int init_sink(struct server_opts *opts);
+void free_sink(struct server_opts *opts);
+void deliver_data(struct delivery_sink *sink, struct stash *stash);
+void flush_sink(struct delivery_sink *sink);
+int write_at_offset(struct delivery_sink *sink, uint32_t seq_num, uint32_t block_len, const char *data, size_t data_len);
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef RELIABLE_UDP_STATS_H
+#define RELIABLE_UDP_STATS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "server.h"
+
+#define STAT_CSV 0      // "<seq>, <seconds>" lines the graph program reads
+#define STAT_BINARY 1   // packed little endian records, seq (4 bytes) then seconds (8 bytes)
+
+#define STAT_RING_SIZE 65536        // records, a power of two
+#define STAT_RECORD_LEN 12
+#define STAT_WRITE_BUF_LEN 65536
+#define STAT_IDLE_NSEC 10000000     // writer sleep when the ring is empty
+
+struct stat_slot {
+    atomic_size_t sequence;     // turn counter, tells producers and the writer whose slot it is
+    uint32_t seq_num;
+    int64_t elapsed;
+};
+
+struct stat_writer {
+    int fd;
+    int format;
+    int started;
+    atomic_int running;
+    pthread_t thread;
+    atomic_size_t head;         // next slot a producer claims
+    size_t tail;                // next slot the writer drains, only it touches this
+    atomic_size_t dropped;
+    struct stat_slot slots[STAT_RING_SIZE];
+};
+
+int parse_stat_format(struct server_opts *opts, const char *arg);
+struct stat_writer *open_stat_writer(const char *path, int format);
+int start_stat_writer(struct stat_writer *writer);
+void record_stat(struct stat_writer *writer, uint32_t seq_num, int64_t elapsed);
+void close_stat_writer(struct stat_writer *writer);
+
+#endif
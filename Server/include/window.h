@@ -0,0 +1,25 @@
+#ifndef RELIABLE_UDP_WINDOW_H
+#define RELIABLE_UDP_WINDOW_H
+
+#include <stdint.h>
+
+#include "server.h"
+
+#define WINDOW_WORD_BITS 64
+
+struct reorder_window {
+    struct stash *slots;    // ring indexed by seq_num & mask, NULL when only completion is tracked
+    uint64_t *occupied;     // one bit per slot, set while it holds a packet
+    uint32_t mask;          // slot count - 1, the slot count is a power of two
+    uint32_t win_size;
+    uint32_t held;          // slots marked, once the expected run is cleared any left sit above a gap
+};
+
+struct reorder_window *alloc_window(uint32_t win_size, int hold_packets);
+void free_window(struct buffer_pool *pool, struct reorder_window *window);
+int window_holds(const struct reorder_window *window, uint32_t seq_num);
+void window_mark(struct reorder_window *window, uint32_t seq_num);
+void window_clear_run(struct reorder_window *window, uint32_t seq_num, uint32_t count);
+uint32_t window_run(const struct reorder_window *window, uint32_t seq_num, uint32_t limit, int held);
+
+#endif
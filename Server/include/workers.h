@@ -0,0 +1,13 @@
+#ifndef RELIABLE_UDP_WORKERS_H
+#define RELIABLE_UDP_WORKERS_H
+
+#include "server.h"
+
+#define MAX_WORKERS 64
+
+int parse_workers(struct server_opts *opts, const char *arg);
+int start_workers(struct server_opts *opts);
+void stop_workers(struct server_opts *opts);
+void pin_to_core(uint32_t worker_id);
+
+#endif
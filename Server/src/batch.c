@@ -0,0 +1,253 @@
+#include "batch.h"
+#include "pool.h"
+#include <netinet/in.h>
+#include <netinet/udp.h>
+
+int init_batches(struct server_opts *opts)
+{
+    struct recv_batch *rx;
+    int gro = opts->gro;
+
+#ifdef UDP_GRO
+    if(gro && setsockopt(opts->sock_fd, IPPROTO_UDP, UDP_GRO, &gro, sizeof(gro)) == -1)
+    {
+        printf("UDP GRO unavailable, receiving single datagrams\n");
+        gro = 0;
+    }
+#else
+    gro = 0;
+#endif
+
+    rx = calloc(1, sizeof(struct recv_batch));
+    opts->ack_batch = calloc(1, sizeof(struct ack_batch));
+    opts->rx_batch = rx;
+    if(rx == NULL || opts->ack_batch == NULL)
+    {
+        opts->msg = strdup("batch allocation failed\n");
+        return -1;
+    }
+
+    //a coalesced message can carry up to 64KB of datagrams, single ones land straight in pool buffers
+    rx->gro = gro;
+    rx->pool = opts->pool;
+    rx->buf_len = gro ? GRO_BUF_LEN : opts->pool->buf_len;
+    if(gro)
+    {
+        rx->buffers = malloc(RECV_BATCH_SIZE * rx->buf_len);
+        if(rx->buffers == NULL)
+        {
+            opts->msg = strdup("batch allocation failed\n");
+            return -1;
+        }
+    }
+
+    for(int i = 0; i < RECV_BATCH_SIZE; ++i)
+    {
+        rx->bufs[i] = POOL_NONE;
+        if(gro)
+        {
+            rx->iovecs[i].iov_base = &rx->buffers[(size_t)i * rx->buf_len];
+        }
+        else if(replace_batch_buffer(rx, i) == -1)
+        {
+            opts->msg = strdup("batch allocation failed\n");
+            return -1;
+        }
+        rx->iovecs[i].iov_len = rx->buf_len;
+        rx->msgs[i].msg_hdr.msg_iov = &rx->iovecs[i];
+        rx->msgs[i].msg_hdr.msg_iovlen = 1;
+        rx->msgs[i].msg_hdr.msg_name = &rx->addrs[i];
+    }
+
+    opts->ack_batch->sock_fd = opts->sock_fd;
+    printf("Receive Batch: %d%s\n", RECV_BATCH_SIZE, gro ? " (UDP GRO)" : "");
+    return 0;
+}
+
+void free_batches(struct server_opts *opts)
+{
+    if(opts->rx_batch)
+    {
+        for(size_t i = 0; i < RECV_BATCH_SIZE; ++i)
+        {
+            if(opts->rx_batch->bufs[i] != POOL_NONE)
+            {
+                pool_release(opts->rx_batch->pool, opts->rx_batch->bufs[i]);
+            }
+        }
+        free(opts->rx_batch->buffers);
+        free(opts->rx_batch);
+        opts->rx_batch = NULL;
+    }
+    if(opts->ack_batch)
+    {
+        flush_acks(opts->ack_batch);
+        free(opts->ack_batch);
+        opts->ack_batch = NULL;
+    }
+}
+
+int receive_batch(int sock_fd, struct recv_batch *batch)
+{
+    int received;
+
+    //the kernel overwrites these, so they are reset before every call
+    for(size_t i = 0; i < RECV_BATCH_SIZE; ++i)
+    {
+        batch->msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        batch->msgs[i].msg_hdr.msg_control = batch->gro ? batch->control[i] : NULL;
+        batch->msgs[i].msg_hdr.msg_controllen = batch->gro ? sizeof(batch->control[i]) : 0;
+        batch->msgs[i].msg_len = 0;
+    }
+
+    //MSG_TRUNC reports the full length of a datagram too big for its buffer, so a probe can grow them
+#ifdef __linux__
+    received = recvmmsg(sock_fd, batch->msgs, RECV_BATCH_SIZE, MSG_TRUNC, NULL);
+#else
+    received = 0;
+    while(received < RECV_BATCH_SIZE)
+    {
+        ssize_t rbytes = recvmsg(sock_fd, &batch->msgs[received].msg_hdr, MSG_TRUNC);
+        if(rbytes < 0)
+        {
+            break;
+        }
+        batch->msgs[received].msg_len = (unsigned int)rbytes;
+        received++;
+    }
+    if(received == 0)
+    {
+        received = -1;
+    }
+#endif
+
+    if(received < 0)
+    {
+        //nothing waiting on the non-blocking socket
+        if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return 0;
+        }
+        return -1;
+    }
+
+    return received;
+}
+
+char *batch_buffer(const struct recv_batch *batch, int index)
+{
+    return batch->iovecs[index].iov_base;
+}
+
+uint32_t batch_pool_buffer(const struct recv_batch *batch, int index)
+{
+    return batch->bufs[index];
+}
+
+int replace_batch_buffer(struct recv_batch *batch, int index)
+{
+    //the old buffer now belongs to whoever took it
+    batch->bufs[index] = pool_acquire(batch->pool);
+    if(batch->bufs[index] == POOL_NONE)
+    {
+        return -1;
+    }
+    batch->iovecs[index].iov_base = pool_buffer(batch->pool, batch->bufs[index]);
+    return 0;
+}
+
+int grow_batch_buffers(struct recv_batch *batch, size_t len)
+{
+    //a coalescing buffer already holds the largest datagram, only held payloads need the bigger pool buffers
+    if(resize_buffer_pool(batch->pool, len) == -1)
+    {
+        return -1;
+    }
+    if(batch->gro || batch->buf_len == batch->pool->buf_len)
+    {
+        return 0;
+    }
+
+    //the batch is fully handled, so every slot can swap its buffer for a bigger one
+    batch->buf_len = batch->pool->buf_len;
+    for(int i = 0; i < RECV_BATCH_SIZE; ++i)
+    {
+        pool_release(batch->pool, batch->bufs[i]);
+        if(replace_batch_buffer(batch, i) == -1)
+        {
+            return -1;
+        }
+        batch->iovecs[i].iov_len = batch->buf_len;
+    }
+    return 0;
+}
+
+size_t batch_segment_size(const struct recv_batch *batch, int index)
+{
+    const struct msghdr *hdr = &batch->msgs[index].msg_hdr;
+
+#ifdef UDP_GRO
+    //a coalesced message reports the size every datagram but the last was cut to
+    if(batch->gro)
+    {
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(hdr); cmsg != NULL; cmsg = CMSG_NXTHDR((struct msghdr *)hdr, cmsg))
+        {
+            if(cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO)
+            {
+                int gso_size;
+                memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+                if(gso_size > 0)
+                {
+                    return (size_t)gso_size;
+                }
+            }
+        }
+    }
+#endif
+
+    return batch->msgs[index].msg_len;
+}
+
+char *next_ack(struct ack_batch *acks, const struct sockaddr *to_addr, socklen_t to_addr_len)
+{
+    if(acks->count == ACK_BATCH_SIZE)
+    {
+        flush_acks(acks);
+    }
+
+    memcpy(&acks->addrs[acks->count], to_addr, to_addr_len);
+    acks->msgs[acks->count].msg_hdr.msg_name = &acks->addrs[acks->count];
+    acks->msgs[acks->count].msg_hdr.msg_namelen = to_addr_len;
+    return acks->acks[acks->count];
+}
+
+void commit_ack(struct ack_batch *acks, size_t ack_len)
+{
+    acks->iovecs[acks->count].iov_base = acks->acks[acks->count];
+    acks->iovecs[acks->count].iov_len = ack_len;
+    acks->msgs[acks->count].msg_hdr.msg_iov = &acks->iovecs[acks->count];
+    acks->msgs[acks->count].msg_hdr.msg_iovlen = 1;
+    acks->count++;
+}
+
+void flush_acks(struct ack_batch *acks)
+{
+    unsigned int sent = 0;
+
+    while(sent < acks->count)
+    {
+#ifdef __linux__
+        int ret = sendmmsg(acks->sock_fd, &acks->msgs[sent], acks->count - sent, 0);
+#else
+        int ret = sendmsg(acks->sock_fd, &acks->msgs[sent].msg_hdr, 0) < 0 ? -1 : 1;
+#endif
+        if(ret <= 0)
+        {
+            //a lost ack is recovered by the client's retransmission, same as one lost on the wire
+            break;
+        }
+        sent += (unsigned int)ret;
+    }
+
+    acks->count = 0;
+}
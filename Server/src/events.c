@@ -0,0 +1,272 @@
+#include "events.h"
+#include <signal.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#else
+#include <poll.h>
+#endif
+
+static int busy_poll(struct server_opts *opts);
+
+int parse_busy_poll(struct server_opts *opts, const char *arg)
+{
+    char *endptr;
+    uintmax_t parsed_value;
+
+    errno = 0;
+    parsed_value = strtoumax(arg, &endptr, 10);
+
+    if (errno != 0 || *endptr != '\0' || parsed_value > MAX_BUSY_POLL_US)
+    {
+        opts->msg = strdup("Busy poll must be between 0 and 100000 microseconds.\n");
+        return -1;
+    }
+
+    opts->busy_poll_max = (uint32_t)parsed_value;
+    return 0;
+}
+
+int init_events(struct server_opts *opts)
+{
+    opts->busy_poll = opts->busy_poll_max;
+
+#ifdef __linux__
+    struct epoll_event event;
+    sigset_t mask;
+
+    opts->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(opts->epoll_fd == -1)
+    {
+        opts->msg = strdup("epoll_create1 failed\n");
+        return -1;
+    }
+
+    opts->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(opts->timer_fd == -1)
+    {
+        opts->msg = strdup("timerfd_create failed\n");
+        return -1;
+    }
+
+    event.events = EPOLLIN;
+    event.data.u32 = EVENT_READABLE;
+    if(epoll_ctl(opts->epoll_fd, EPOLL_CTL_ADD, opts->sock_fd, &event) == -1)
+    {
+        opts->msg = strdup("epoll_ctl failed\n");
+        return -1;
+    }
+    //every worker sweeps its own sessions and sends its own delayed acks
+    event.data.u32 = EVENT_TIMER;
+    if(epoll_ctl(opts->epoll_fd, EPOLL_CTL_ADD, opts->timer_fd, &event) == -1)
+    {
+        opts->msg = strdup("epoll_ctl failed\n");
+        return -1;
+    }
+
+    //signals go to the main thread, which tells the workers to stop
+    if(opts->worker_id != 0)
+    {
+        event.data.u32 = EVENT_STOP;
+        if(epoll_ctl(opts->epoll_fd, EPOLL_CTL_ADD, opts->stop_fd, &event) == -1)
+        {
+            opts->msg = strdup("epoll_ctl failed\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    //signals arrive as reads once they are blocked for normal delivery, workers started later inherit the mask
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    if(pthread_sigmask(SIG_BLOCK, &mask, &opts->saved_sigmask) != 0)
+    {
+        opts->msg = strdup("pthread_sigmask failed\n");
+        return -1;
+    }
+    opts->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(opts->signal_fd == -1)
+    {
+        opts->msg = strdup("signalfd failed\n");
+        return -1;
+    }
+    event.data.u32 = EVENT_SIGNAL;
+    if(epoll_ctl(opts->epoll_fd, EPOLL_CTL_ADD, opts->signal_fd, &event) == -1)
+    {
+        opts->msg = strdup("epoll_ctl failed\n");
+        return -1;
+    }
+#endif
+
+    printf("Busy Poll: %u us\n", opts->busy_poll_max);
+    return 0;
+}
+
+void close_events(struct server_opts *opts)
+{
+    if(opts->epoll_fd > 0)
+    {
+        close(opts->epoll_fd);
+    }
+    if(opts->signal_fd > 0)
+    {
+        close(opts->signal_fd);
+    }
+    if(opts->timer_fd > 0)
+    {
+        close(opts->timer_fd);
+    }
+}
+
+uint64_t monotonic_usec(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + (uint64_t)now.tv_nsec / 1000;
+}
+
+static int busy_poll(struct server_opts *opts)
+{
+    uint64_t deadline = monotonic_usec() + opts->busy_poll;
+    char byte;
+
+    do
+    {
+        if(recv(opts->sock_fd, &byte, sizeof(byte), MSG_PEEK | MSG_DONTWAIT) >= 0)
+        {
+            //traffic came back inside the window, so spin a little longer next time
+            opts->busy_poll = opts->busy_poll * 2 < opts->busy_poll_max ? opts->busy_poll * 2 : opts->busy_poll_max;
+            return EVENT_READABLE;
+        }
+    } while(monotonic_usec() < deadline);
+
+    //the spin was wasted, halve it so an idle link quickly goes back to sleeping
+    opts->busy_poll = opts->busy_poll / 2 > MIN_BUSY_POLL_US ? opts->busy_poll / 2 : MIN_BUSY_POLL_US;
+    return 0;
+}
+
+int wait_for_events(struct server_opts *opts)
+{
+    int ready = 0;
+
+    if(opts->busy_poll_max > 0 && busy_poll(opts) == EVENT_READABLE)
+    {
+        return EVENT_READABLE;
+    }
+
+#ifdef __linux__
+    struct epoll_event events[3];
+    int count;
+
+    count = epoll_wait(opts->epoll_fd, events, sizeof(events) / sizeof(events[0]), -1);
+    if(count == -1)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+
+    for(int i = 0; i < count; ++i)
+    {
+        if(events[i].data.u32 == EVENT_SIGNAL)
+        {
+            struct signalfd_siginfo info;
+            while(read(opts->signal_fd, &info, sizeof(info)) == sizeof(info))
+            {
+            }
+        }
+        else if(events[i].data.u32 == EVENT_TIMER)
+        {
+            uint64_t expirations;
+            if(read(opts->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+            {
+                continue;
+            }
+        }
+        ready |= (int)events[i].data.u32;
+    }
+#else
+    struct pollfd sock;
+    int timeout = -1;
+    int count;
+
+    //without timerfd the poll itself times out at the deadline the timer would have fired at
+    if(opts->timer_deadline != 0)
+    {
+        uint64_t now = monotonic_usec();
+        timeout = opts->timer_deadline > now ? (int)((opts->timer_deadline - now + 999) / 1000) : 0;
+    }
+
+    //without signalfd a signal shows up as an interrupted poll, and the handler sets exit_flag
+    sock.fd = opts->sock_fd;
+    sock.events = POLLIN;
+    count = poll(&sock, 1, timeout);
+    if(count == -1)
+    {
+        return errno == EINTR ? 0 : -1;
+    }
+    ready = count > 0 ? EVENT_READABLE : EVENT_TIMER;
+#endif
+
+    return ready;
+}
+
+int signal_pending(struct server_opts *opts)
+{
+    int pending = 0;
+
+#ifdef __linux__
+    struct signalfd_siginfo info;
+
+    //non-blocking, a busy socket never gets to the wait that would otherwise report it
+    while(opts->signal_fd > 0 && read(opts->signal_fd, &info, sizeof(info)) == sizeof(info))
+    {
+        pending = 1;
+    }
+#else
+    //without signalfd the handler sets exit_flag itself
+    (void)opts;
+#endif
+
+    return pending;
+}
+
+void arm_next_timer(struct server_opts *opts)
+{
+    uint64_t deadline = opts->sweep_deadline;
+    uint64_t now;
+
+    //the timer serves whichever comes first, the delayed acks or the idle sweep
+    if(opts->ack_deadline != 0 && opts->ack_deadline < deadline)
+    {
+        deadline = opts->ack_deadline;
+    }
+    if(deadline == opts->timer_deadline)
+    {
+        return;
+    }
+
+    opts->timer_deadline = deadline;
+    now = monotonic_usec();
+    //already due, the smallest delay still fires it since zero would disarm it
+    arm_event_timer(opts, deadline > now ? deadline - now : 1);
+}
+
+int arm_event_timer(struct server_opts *opts, uint64_t usec)
+{
+#ifdef __linux__
+    struct itimerspec spec;
+
+    //a zero delay disarms the timer
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = (time_t)(usec / 1000000);
+    spec.it_value.tv_nsec = (long)(usec % 1000000) * 1000;
+    return timerfd_settime(opts->timer_fd, 0, &spec, NULL);
+#else
+    (void)opts;
+    (void)usec;
+    return -1;
+#endif
+}
@@ -0,0 +1,253 @@
+#include "fec.h"
+#include "session.h"
+#include "window.h"
+#include "pool.h"
+
+static struct fec_decoder *alloc_fec_decoder(uint32_t group_size, uint32_t parity_count, uint32_t win_size,
+                                             uint32_t payload_len);
+static struct fec_group *find_group(struct fec_decoder *fec, uint32_t group_num);
+static uint8_t *group_row(const struct fec_decoder *fec, const struct fec_group *group, uint32_t row);
+static void xor_into(uint8_t *restrict dst, const uint8_t *restrict src, size_t len);
+static void try_rebuild(struct server_opts *opts, struct session *session, struct fec_group *group, uint32_t row,
+                        struct sockaddr *from_addr, socklen_t *from_addr_len);
+
+static struct fec_decoder *alloc_fec_decoder(uint32_t group_size, uint32_t parity_count, uint32_t win_size,
+                                             uint32_t payload_len)
+{
+    struct fec_decoder *fec = calloc(1, sizeof(struct fec_decoder));
+    uint32_t slots = 1;
+
+    if(fec == NULL)
+    {
+        return NULL;
+    }
+
+    //enough groups to span the window, parity arrives right behind its group so more would sit idle
+    while(slots < win_size / group_size + 2 && slots < FEC_MAX_GROUPS)
+    {
+        slots <<= 1;
+    }
+    fec->group_size = group_size;
+    fec->parity_count = parity_count;
+    fec->mask = slots - 1;
+    fec->stride = ((size_t)payload_len + FEC_ALIGN - 1) / FEC_ALIGN * FEC_ALIGN;
+    fec->groups = calloc(slots, sizeof(struct fec_group));
+    fec->rows = aligned_alloc(FEC_ALIGN, (size_t)slots * parity_count * fec->stride);
+    fec->scratch = malloc(HEADER_LEN + fec->stride + TRAILER_LEN);
+    if(fec->groups == NULL || fec->rows == NULL || fec->scratch == NULL)
+    {
+        free_fec_decoder(fec);
+        return NULL;
+    }
+    return fec;
+}
+
+void free_fec_decoder(struct fec_decoder *fec)
+{
+    if(fec == NULL)
+    {
+        return;
+    }
+    free(fec->groups);
+    free(fec->rows);
+    free(fec->scratch);
+    free(fec);
+}
+
+static struct fec_group *find_group(struct fec_decoder *fec, uint32_t group_num)
+{
+    struct fec_group *group = &fec->groups[group_num & fec->mask];
+
+    if(group->in_use && group->group == group_num)
+    {
+        return group;
+    }
+    //a late packet of a group whose slot has already moved on
+    if(group->in_use && (int32_t)(group_num - group->group) < 0)
+    {
+        return NULL;
+    }
+
+    //the slot's old group is long past the window, start over for this one
+    memset(group, 0, sizeof(struct fec_group));
+    group->in_use = 1;
+    group->group = group_num;
+    memset(group_row(fec, group, 0), 0, fec->parity_count * fec->stride);
+    return group;
+}
+
+static uint8_t *group_row(const struct fec_decoder *fec, const struct fec_group *group, uint32_t row)
+{
+    size_t slot = (size_t)(group - fec->groups);
+
+    return &fec->rows[(slot * fec->parity_count + row) * fec->stride];
+}
+
+static void xor_into(uint8_t *restrict dst, const uint8_t *restrict src, size_t len)
+{
+    size_t i = 0;
+
+    //a word at a time over pointers that never alias, which compilers widen to vector xors
+    for(; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t))
+    {
+        uint64_t a;
+        uint64_t b;
+
+        memcpy(&a, &dst[i], sizeof(a));
+        memcpy(&b, &src[i], sizeof(b));
+        a ^= b;
+        memcpy(&dst[i], &a, sizeof(a));
+    }
+    for(; i < len; ++i)
+    {
+        dst[i] ^= src[i];
+    }
+}
+
+void fec_record_packet(struct server_opts *opts, struct session *session, const struct packet *pkt, size_t len,
+                       struct sockaddr *from_addr, socklen_t *from_addr_len)
+{
+    struct fec_decoder *fec = session->fec;
+    uint32_t member = pkt->header->seq_num % fec->group_size;
+    uint32_t row = member % fec->parity_count;
+    size_t data_len;
+    struct fec_group *group;
+
+    //the bytes that went out, the same ones the sender folded into its parity
+    if(pkt->header->data_len < TRAILER_LEN || pkt->header->data_len > len - HEADER_LEN ||
+       (size_t)(pkt->header->data_len - TRAILER_LEN) > fec->stride)
+    {
+        return;
+    }
+    data_len = pkt->header->data_len - TRAILER_LEN;
+
+    group = find_group(fec, pkt->header->seq_num / fec->group_size);
+    if(group == NULL || (group->received & ((uint64_t)1 << member)))
+    {
+        return;
+    }
+    xor_into(group_row(fec, group, row), (const uint8_t *)pkt->data, data_len);
+    group->len_xor[row] ^= pkt->header->data_len;
+    group->received |= (uint64_t)1 << member;
+
+    try_rebuild(opts, session, group, row, from_addr, from_addr_len);
+}
+
+void fec_receive_parity(struct server_opts *opts, struct session *session, const struct packet *pkt, size_t len,
+                        struct sockaddr *from_addr, socklen_t *from_addr_len)
+{
+    //the ack field carries the layout, group size, members in this group, parity count and which parity this is
+    uint32_t group_size = pkt->header->ack_num >> 24;
+    uint32_t members = (pkt->header->ack_num >> 16) & 0xFF;
+    uint32_t parity_count = (pkt->header->ack_num >> 8) & 0xFF;
+    uint32_t row = pkt->header->ack_num & 0xFF;
+    struct fec_decoder *fec = session->fec;
+    struct fec_group *group;
+    size_t parity_len;
+
+    if(group_size == 0 || group_size > FEC_MAX_GROUP || parity_count == 0 || parity_count > FEC_MAX_PARITY ||
+       parity_count > group_size || members == 0 || members > group_size || row >= parity_count ||
+       pkt->header->seq_num % group_size != 0 || len < HEADER_LEN + TRAILER_LEN)
+    {
+        return;
+    }
+
+    //the first parity packet turns recovery on, groups whose packets came before it are simply not covered
+    if(fec == NULL)
+    {
+        fec = alloc_fec_decoder(group_size, parity_count, opts->win_size, session->payload_len);
+        if(fec == NULL)
+        {
+            return;
+        }
+        session->fec = fec;
+    }
+    //the sender keeps one layout for the whole transfer
+    if(fec->group_size != group_size || fec->parity_count != parity_count)
+    {
+        return;
+    }
+
+    parity_len = len - HEADER_LEN - TRAILER_LEN;
+    if(parity_len > fec->stride)
+    {
+        return;
+    }
+
+    group = find_group(fec, pkt->header->seq_num / group_size);
+    if(group == NULL || (group->parity_seen & (1u << row)))
+    {
+        return;
+    }
+    group->members = members;
+    xor_into(group_row(fec, group, row), (const uint8_t *)pkt->data, parity_len);
+    group->len_xor[row] ^= pkt->header->data_len;
+    group->parity_seen |= (uint8_t)(1u << row);
+
+    try_rebuild(opts, session, group, row, from_addr, from_addr_len);
+}
+
+static void try_rebuild(struct server_opts *opts, struct session *session, struct fec_group *group, uint32_t row,
+                        struct sockaddr *from_addr, socklen_t *from_addr_len)
+{
+    struct fec_decoder *fec = session->fec;
+    struct packet_header header;
+    struct packet pkt;
+    uint64_t covered = 0;
+    uint64_t missing;
+    uint32_t member;
+    uint32_t seq_num;
+    uint16_t data_len;
+    uint32_t net_seq_num;
+    uint32_t net_ack_num = 0;
+    uint8_t flags = ACK;
+    uint16_t net_data_len;
+    char *out = fec->scratch;
+
+    if(group->members == 0 || !(group->parity_seen & (1u << row)))
+    {
+        return;
+    }
+
+    //a row can stand in for exactly one of its members
+    for(uint32_t i = row; i < group->members; i += fec->parity_count)
+    {
+        covered |= (uint64_t)1 << i;
+    }
+    missing = covered & ~group->received;
+    if(missing == 0 || (missing & (missing - 1)) != 0)
+    {
+        return;
+    }
+    member = (uint32_t)__builtin_ctzll(missing);
+    seq_num = group->group * fec->group_size + member;
+
+    //arrived before recovery was on, so it was never folded in, the row is just that packet again
+    if((int32_t)(seq_num - session->client_seq_num) < 0 || window_holds(session->window, seq_num))
+    {
+        group->received |= missing;
+        return;
+    }
+    data_len = group->len_xor[row];
+    if(data_len < TRAILER_LEN || (size_t)(data_len - TRAILER_LEN) > fec->stride)
+    {
+        return;
+    }
+
+    //laid out exactly as the lost datagram was, so it takes the same path a retransmission would
+    net_seq_num = htonl(seq_num);
+    net_data_len = htons(data_len);
+    memcpy(&out[0], &net_seq_num, sizeof(net_seq_num));
+    memcpy(&out[4], &net_ack_num, sizeof(net_ack_num));
+    memcpy(&out[FLAGS_OFFSET], &flags, sizeof(flags));
+    memcpy(&out[FLAGS_OFFSET + 1], &net_data_len, sizeof(net_data_len));
+    memcpy(&out[HEADER_LEN], group_row(fec, group, row), data_len - TRAILER_LEN);
+    out[HEADER_LEN + data_len - 3] = '\0';
+    out[HEADER_LEN + data_len - 2] = '\x03';
+    out[HEADER_LEN + data_len - 1] = '\x03';
+
+    pkt.header = &header;
+    deserialize_packet(out, HEADER_LEN + data_len, &pkt);
+    //its own record finds the row complete, so this never rebuilds again
+    accept_packet(opts, session, &pkt, HEADER_LEN + data_len, POOL_NONE, from_addr, from_addr_len);
+}
@@ -3,13 +3,14 @@
 //
 
 #include "helpers.h"
+#include "stats.h"
 
-void write_to_graph(FILE *graph, uint32_t ack_num, time_t start_time)
+void write_to_graph(struct stat_writer *graph, uint32_t ack_num, time_t start_time)
 {
     time_t now = time(0);
     now = now - start_time;
-    fprintf(graph, "%d, %ld\n", ack_num, now);
-    fflush(graph);
+    //queued, the stats thread formats and writes in batches
+    record_stat(graph, ack_num, now);
 }
 void write_to_stat(FILE *stat, uint32_t server_seq_num, uint32_t client_seq_num)
 {
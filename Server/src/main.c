@@ -1,12 +1,17 @@
 #include <stdbool.h>
 #include <signal.h>
 #include "server.h"
+#include "batch.h"
+#include "events.h"
+#include "session.h"
+#include "sink.h"
+#include "pool.h"
 
-int volatile exit_flag = false;
+atomic_int exit_flag = false;
 
 void sigHandler(int signal) {
-    exit_flag = true;
-    printf("exit_flag set to %d\n", exit_flag);
+    atomic_store(&exit_flag, true);
+    printf("exit_flag set to %d\n", atomic_load(&exit_flag));
 }
 
 static int compare_transitions(const void *a, const void *b);
@@ -83,16 +88,45 @@ static enum state_codes lookup_transitions(enum state_codes current_state, enum
 int do_read(void *arg)
 {
     struct server_opts *opts = (struct server_opts *) arg;
-    struct sockaddr from_addr;
-    socklen_t from_addr_len = sizeof(struct sockaddr_in);
-    char buffer[MAX_LEN];
-    int ret;
-
-    memset(buffer, 0, MAX_LEN);
-    ret = fill_buffer(opts->sock_fd, buffer, &from_addr, &from_addr_len);
-    if (ret == 0)
+    int events;
+
+    //sleep until the socket, a signal or a timer needs attention instead of spinning on the non-blocking socket
+    if(read_batch(opts) == 0)
+    {
+        //no longer than the oldest delayed ack may wait
+        arm_next_timer(opts);
+        events = wait_for_events(opts);
+        if(events == -1)
+        {
+            opts->msg = strdup("epoll_wait failed\n");
+        }
+        else if(events & EVENT_SIGNAL)
+        {
+            atomic_store(&exit_flag, true);
+            printf("exit_flag set to %d\n", atomic_load(&exit_flag));
+        }
+        else if(events & EVENT_TIMER)
+        {
+            uint64_t now = monotonic_usec();
+
+            if(opts->ack_deadline != 0 && now >= opts->ack_deadline)
+            {
+                send_delayed_acks(opts);
+                flush_acks(opts->ack_batch);
+            }
+            if(now >= opts->sweep_deadline)
+            {
+                evict_idle_sessions(opts, time(0));
+                opts->sweep_deadline = now + (uint64_t)SESSION_SWEEP_INTERVAL * 1000000;
+            }
+            arm_next_timer(opts);
+        }
+    }
+    //the socket kept the batch full, so the signals are checked here instead
+    else if(signal_pending(opts))
     {
-        handle_data_in(opts, buffer, &opts->client_seq_num, &opts->server_seq_num, opts->window, &from_addr, &from_addr_len);
+        atomic_store(&exit_flag, true);
+        printf("exit_flag set to %d\n", atomic_load(&exit_flag));
     }
 
     if(opts->msg)
@@ -100,7 +134,7 @@ int do_read(void *arg)
         return error;
     }
 
-    if(exit_flag == true)
+    if(atomic_load(&exit_flag))
     {
         return done;
     }
@@ -108,16 +142,86 @@ int do_read(void *arg)
     return ok;
 }
 
-int fill_buffer(int sock_fd, char *buffer,  struct sockaddr *from_addr, socklen_t *from_addr_len)
+int read_batch(struct server_opts *opts)
 {
-    ssize_t rbytes = recvfrom(sock_fd, buffer, MAX_LEN, 0, from_addr, from_addr_len);
-    if(rbytes > 0)
+    struct recv_batch *rx = opts->rx_batch;
+    size_t grow_len = 0;
+    int received;
+
+    received = receive_batch(opts->sock_fd, rx);
+    if(received == -1)
+    {
+        opts->msg = strdup("recvmmsg failed\n");
+        return -1;
+    }
+
+    //every datagram of the batch is handled before returning to the state machine
+    for(int i = 0; i < received; ++i)
+    {
+        char *buffer = batch_buffer(rx, i);
+        size_t len = rx->msgs[i].msg_len;
+        size_t segment = batch_segment_size(rx, i);
+        socklen_t from_addr_len = rx->msgs[i].msg_hdr.msg_namelen;
+        struct session *session = find_session(opts->sessions, (struct sockaddr *) &rx->addrs[i], from_addr_len);
+
+        //no memory for a new peer, drop it and let it retransmit
+        if(session == NULL)
+        {
+            continue;
+        }
+
+        //only a probe may outgrow the buffers, its header still landed whole and the buffers grow to fit the next one
+        if(rx->msgs[i].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+            if(len > MAX_DATAGRAM_LEN || !(buffer[FLAGS_OFFSET] & PROBE))
+            {
+                continue;
+            }
+            len = segment = rx->iovecs[i].iov_len;
+            grow_len = rx->msgs[i].msg_len > grow_len ? rx->msgs[i].msg_len : grow_len;
+        }
+        //a coalescing buffer fits any probe, but payloads that size would not fit the buffers they are held in
+        else if(segment > rx->pool->buf_len && segment <= MAX_DATAGRAM_LEN && (buffer[FLAGS_OFFSET] & PROBE))
+        {
+            grow_len = segment > grow_len ? segment : grow_len;
+        }
+
+        for(size_t offset = 0; segment > 0 && offset < len; offset += segment)
+        {
+            size_t seg_len = len - offset < segment ? len - offset : segment;
+
+            //a stashed packet keeps its buffer until delivery, the batch slot gets a fresh one
+            if(handle_data_in(opts, session, &buffer[offset], seg_len, batch_pool_buffer(rx, i),
+                              (struct sockaddr *) &rx->addrs[i], &from_addr_len) == 1 &&
+               replace_batch_buffer(rx, i) == -1)
+            {
+                opts->msg = strdup("buffer pool exhausted\n");
+                return -1;
+            }
+        }
+    }
+
+    //once nothing in the batch is left to read from its buffers
+    if(grow_len > 0)
+    {
+        if(grow_batch_buffers(rx, grow_len) == -1)
+        {
+            opts->msg = strdup("buffer pool exhausted\n");
+            return -1;
+        }
+        size_receive_buffer(opts, grow_len);
+    }
+
+    //a steady stream never lets the timer fire, so delayed acks that are due ride along with this batch's
+    if(opts->ack_deadline != 0 && monotonic_usec() >= opts->ack_deadline)
     {
-//        printf("handling data, rbytes: %zd\n", rbytes);
-        return 0;
+        send_delayed_acks(opts);
     }
-    return -1;
 
+    //the payloads delivered by the batch are written together, and its acks leave together
+    flush_sink(opts->sink);
+    flush_acks(opts->ack_batch);
+    return received;
 }
 
 void print_packet(struct packet *pkt)
@@ -127,6 +231,6 @@ void print_packet(struct packet *pkt)
     printf("Ack Num: %d\n", pkt->header->ack_num);
     printf("Flags: %d\n", pkt->header->flags);
     printf("Data Len: %d\n", pkt->header->data_len);
-    printf("Data: %s\n", pkt->data);
+    printf("Data: %.*s\n", (int)pkt->data_len, pkt->data);
 
 }
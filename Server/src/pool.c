@@ -0,0 +1,162 @@
+#include "pool.h"
+#include "batch.h"
+#include "sink.h"
+
+static int grow_pool(struct buffer_pool *pool);
+static size_t slab_buf_len(const struct buffer_pool *pool, uint32_t index);
+
+int init_buffer_pool(struct server_opts *opts)
+{
+    //one buffer per batch slot, per payload waiting to be written and per stashed packet of a full window,
+    //positional writes never hold a packet past its arrival
+    size_t buffers = RECV_BATCH_SIZE + SINK_BATCH_SIZE + (opts->sink_type == SINK_POSITIONAL ? 0 : opts->win_size);
+
+    opts->pool = calloc(1, sizeof(struct buffer_pool));
+    if(opts->pool == NULL)
+    {
+        opts->msg = strdup("buffer pool allocation failed\n");
+        return -1;
+    }
+    opts->pool->buf_len = POOL_BUF_LEN;
+
+    //allocated up front so the steady state never reaches malloc
+    while(opts->pool->slab_count * POOL_SLAB_SIZE < buffers)
+    {
+        if(grow_pool(opts->pool) == -1)
+        {
+            opts->msg = strdup("buffer pool allocation failed\n");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int grow_pool(struct buffer_pool *pool)
+{
+    size_t capacity = (pool->slab_count + 1) * POOL_SLAB_SIZE;
+    char **slabs;
+    size_t *slab_buf_lens;
+    uint32_t *free_list;
+    char *slab;
+
+    if(capacity > POOL_NONE)
+    {
+        return -1;
+    }
+
+    slab = malloc((size_t)POOL_SLAB_SIZE * pool->buf_len);
+    slabs = realloc(pool->slabs, (pool->slab_count + 1) * sizeof(char *));
+    if(slabs)
+    {
+        pool->slabs = slabs;
+    }
+    slab_buf_lens = realloc(pool->slab_buf_lens, (pool->slab_count + 1) * sizeof(size_t));
+    if(slab_buf_lens)
+    {
+        pool->slab_buf_lens = slab_buf_lens;
+    }
+    if(slabs == NULL || slab_buf_lens == NULL || slab == NULL)
+    {
+        free(slab);
+        return -1;
+    }
+
+    free_list = realloc(pool->free_list, capacity * sizeof(uint32_t));
+    if(free_list == NULL)
+    {
+        free(slab);
+        return -1;
+    }
+    pool->free_list = free_list;
+
+    //only the new slab's buffers are free, everything else is still out
+    for(uint32_t i = 0; i < POOL_SLAB_SIZE; ++i)
+    {
+        pool->free_list[pool->free_count++] = (uint32_t)(pool->slab_count * POOL_SLAB_SIZE) + i;
+    }
+    pool->slab_buf_lens[pool->slab_count] = pool->buf_len;
+    pool->slabs[pool->slab_count++] = slab;
+    return 0;
+}
+
+static size_t slab_buf_len(const struct buffer_pool *pool, uint32_t index)
+{
+    return pool->slab_buf_lens[index >> POOL_SLAB_SHIFT];
+}
+
+uint32_t pool_acquire(struct buffer_pool *pool)
+{
+    //only grows when more packets are held than ever before
+    if(pool->free_count == 0 && grow_pool(pool) == -1)
+    {
+        return POOL_NONE;
+    }
+
+    return pool->free_list[--pool->free_count];
+}
+
+void pool_release(struct buffer_pool *pool, uint32_t index)
+{
+    //buffers from before the pool grew are retired as they come back
+    if(slab_buf_len(pool, index) < pool->buf_len)
+    {
+        return;
+    }
+    pool->free_list[pool->free_count++] = index;
+}
+
+char *pool_buffer(const struct buffer_pool *pool, uint32_t index)
+{
+    return &pool->slabs[index >> POOL_SLAB_SHIFT][(size_t)(index & (POOL_SLAB_SIZE - 1)) * slab_buf_len(pool, index)];
+}
+
+int resize_buffer_pool(struct buffer_pool *pool, size_t len)
+{
+    size_t buf_len = pool->buf_len;
+    size_t kept = 0;
+
+    if(len <= buf_len)
+    {
+        return 0;
+    }
+    if(len > MAX_DATAGRAM_LEN)
+    {
+        return -1;
+    }
+
+    //doubling keeps a search of many probe sizes down to a few resizes
+    while(buf_len < len)
+    {
+        buf_len *= 2;
+    }
+    pool->buf_len = buf_len < MAX_DATAGRAM_LEN ? buf_len : MAX_DATAGRAM_LEN;
+
+    //the old slabs are never handed out again, their memory goes when the pool is freed
+    for(size_t i = 0; i < pool->free_count; ++i)
+    {
+        if(slab_buf_len(pool, pool->free_list[i]) >= pool->buf_len)
+        {
+            pool->free_list[kept++] = pool->free_list[i];
+        }
+    }
+    pool->free_count = kept;
+    return 0;
+}
+
+void free_buffer_pool(struct server_opts *opts)
+{
+    if(opts->pool == NULL)
+    {
+        return;
+    }
+
+    for(size_t i = 0; i < opts->pool->slab_count; ++i)
+    {
+        free(opts->pool->slabs[i]);
+    }
+    free(opts->pool->slabs);
+    free(opts->pool->slab_buf_lens);
+    free(opts->pool->free_list);
+    free(opts->pool);
+    opts->pool = NULL;
+}
@@ -2,6 +2,15 @@
 // Created by Colin Lam on 2023-11-13.
 //
 #include "server.h"
+#include "batch.h"
+#include "events.h"
+#include "session.h"
+#include "workers.h"
+#include "pool.h"
+#include "window.h"
+#include "sink.h"
+#include "stats.h"
+#include "fec.h"
 
 int entry_state(void *arg)
 {
@@ -12,14 +21,85 @@ int entry_state(void *arg)
 int parse_args(void *arg)
 {
     struct server_opts *opts = (struct server_opts *) arg;
+    int option;
 
-    if(opts->argc != SERVER_ARGS && opts->argc != GRAPH_ARGS)
+    opts->win_size = DEFAULT_WIN_SIZE;
+    opts->ack_every = DEFAULT_ACK_EVERY;
+    opts->workers = 1;
+    opterr = 0;
+
+    while((option = getopt(opts->argc, opts->argv, "goa:b:d:l:r:t:w:")) != -1)
+    {
+        switch(option)
+        {
+            case 'g':
+                opts->graph = 1;
+                break;
+            case 'o':
+                opts->gro = 1;
+                break;
+            case 'a':
+                if(parse_ack_every(opts, optarg) == -1)
+                {
+                    return error;
+                }
+                break;
+            case 'b':
+                if(parse_busy_poll(opts, optarg) == -1)
+                {
+                    return error;
+                }
+                break;
+            case 'd':
+                if(parse_sink(opts, optarg) == -1)
+                {
+                    return error;
+                }
+                break;
+            case 'l':
+                if(parse_stat_format(opts, optarg) == -1)
+                {
+                    return error;
+                }
+                break;
+            case 'r':
+                if(parse_receive_file(opts, optarg) == -1)
+                {
+                    return error;
+                }
+                break;
+            case 't':
+                if(parse_workers(opts, optarg) == -1)
+                {
+                    return error;
+                }
+                break;
+            case 'w':
+                if(parse_win_size(opts, optarg) == -1)
+                {
+                    return error;
+                }
+                break;
+            default:
+                opts->msg = strdup("Usage: server <ip> <port> [-g] [-o] [-a ack every] [-b busy poll us] [-d print|stdout|discard|file] [-l csv|binary] [-r receive file] [-t workers] [-w window size]\n");
+                return error;
+        }
+    }
+
+    //the graph program only reads the csv stats
+    if(opts->graph && opts->stat_format == STAT_BINARY)
+    {
+        opts->msg = strdup("The graph needs csv stats, -g cannot be used with -l binary\n");
+        return error;
+    }
+
+    if(opts->argc - optind != SERVER_ARGS)
     {
         opts->msg = strdup("Invalid number of arguments\n");
         return error;
     }
 
-    opts->host_ip = strdup(opts->argv[IP_INDEX]);
+    opts->host_ip = strdup(opts->argv[optind + IP_INDEX]);
     opts->ip_family = get_ip_family(opts->host_ip);
     if(opts->ip_family == -1)
     {
@@ -32,19 +112,12 @@ int parse_args(void *arg)
         return error;
     }
 
-    if(opts->argc == GRAPH_ARGS)
-    {
-        if(strcmp(opts->argv[GRAPH_INDEX], "-g") != 0)
-        {
-            opts->msg = strdup("pass \"-g\" to start the graphing program\n");
-            return error;
-        }
-    }
-
     printf("---------------------------- Server Options ----------------------------\n");
     printf("Server IP Address: %s\n", opts->host_ip);
     printf("Server Domain: %d\n", opts->ip_family);
     printf("Server Port: %hu\n", opts->host_port);
+    printf("Window Size: %u\n", opts->win_size);
+    printf("Ack Every: %u\n", opts->ack_every);
 
     return ok;
 
@@ -73,7 +146,7 @@ int parse_in_port_t(struct server_opts *opts)
     char *endptr;
     uintmax_t parsed_value;
 
-    parsed_value = strtoumax(opts->argv[PORT_INDEX], &endptr, 10);
+    parsed_value = strtoumax(opts->argv[optind + PORT_INDEX], &endptr, 10);
 
     if (errno != 0)
     {
@@ -99,45 +172,85 @@ int parse_in_port_t(struct server_opts *opts)
     return 0;
 }
 
+int parse_win_size(struct server_opts *opts, const char *arg)
+{
+    char *endptr;
+    uintmax_t parsed_value;
+
+    errno = 0;
+    parsed_value = strtoumax(arg, &endptr, 10);
+
+    if (errno != 0 || *endptr != '\0' || parsed_value == 0 || parsed_value > MAX_WIN_SIZE)
+    {
+        opts->msg = strdup("Window size must be between 1 and 65536.\n");
+        return -1;
+    }
+
+    opts->win_size = (uint32_t)parsed_value;
+    return 0;
+}
+
+int parse_ack_every(struct server_opts *opts, const char *arg)
+{
+    char *endptr;
+    uintmax_t parsed_value;
+
+    errno = 0;
+    parsed_value = strtoumax(arg, &endptr, 10);
+
+    if (errno != 0 || *endptr != '\0' || parsed_value == 0 || parsed_value > MAX_ACK_EVERY)
+    {
+        opts->msg = strdup("Ack every must be between 1 and 64 packets.\n");
+        return -1;
+    }
+
+    opts->ack_every = (uint32_t)parsed_value;
+    return 0;
+}
+
 int set_up(void *arg) {
     struct server_opts *opts = (struct server_opts *) arg;
-    struct sockaddr_in addr;
     int ret;
 
-    opts->sock_fd = socket(opts->ip_family, SOCK_DGRAM, 0);
-    if (opts->sock_fd == -1) {
-        opts->msg = strdup("socket failed\n");
+    if(open_socket(opts) == -1)
+    {
         return error;
     }
 
-    addr.sin_family = opts->ip_family;
-    addr.sin_port = htons(opts->host_port);
-    addr.sin_addr.s_addr = inet_addr(opts->host_ip);
-    if (addr.sin_addr.s_addr == (in_addr_t) -1) {
-        opts->msg = strdup("inet_addr failed\n");
+    printf("---------------------------- Server Options ----------------------------\n");
+    if(open_sink_output(opts) == -1)
+    {
         return error;
     }
-
-    ret = bind(opts->sock_fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_in));
-    if (ret == -1) {
-        opts->msg = strdup("bind failed\n");
+    if(init_buffer_pool(opts) == -1 || init_sink(opts) == -1)
+    {
         return error;
     }
-
-    ret = set_socket_non_block(opts);
-    if(ret == -1)
+    if(init_sessions(opts) == -1)
     {
         return error;
     }
-
-    printf("---------------------------- Server Options ----------------------------\n");
-    init_window(opts);
-    init_graphing(opts);
-    if(opts->argc == GRAPH_ARGS)
+    if(init_batches(opts) == -1)
+    {
+        return error;
+    }
+    if(init_events(opts) == -1)
+    {
+        return error;
+    }
+    opts->sweep_deadline = monotonic_usec() + (uint64_t)SESSION_SWEEP_INTERVAL * 1000000;
+    arm_next_timer(opts);
+    if(init_graphing(opts) == -1)
+    {
+        return error;
+    }
+    if(opts->graph)
     {
         pid_t pid = fork();
         if(pid == 0)
         {
+            //a blocked mask survives exec, so Ctrl-C would no longer stop the graph program
+            sigprocmask(SIG_SETMASK, &opts->saved_sigmask, NULL);
             ret = execlp("python3", "python3", "main.py", "-s", "./graph.txt", NULL);
             if(ret == -1)
             {
@@ -161,26 +274,69 @@ int set_up(void *arg) {
     {
         opts->running = 1;
     }
+    //after the fork, so the graph program is not started from a threaded process
+    if(start_stat_writer(opts->graph_stats) == -1)
+    {
+        opts->msg = strdup("stats thread failed\n");
+        return error;
+    }
+    if(start_workers(opts) == -1)
+    {
+        return error;
+    }
     printf("Finished Set up\n");
     return ok;
 }
 
-void init_window(struct server_opts *opts)
+int open_socket(struct server_opts *opts)
 {
-    opts->client_seq_num = 0;
-    opts->server_seq_num = 0;
-    for(size_t i = 0; i < WIN_SIZE; ++i)
-    {
-        reset_stash(&opts->window[i]);
+    struct sockaddr_in addr;
+    int ret;
+
+    opts->sock_fd = socket(opts->ip_family, SOCK_DGRAM, 0);
+    if (opts->sock_fd == -1) {
+        opts->msg = strdup("socket failed\n");
+        return -1;
+    }
+
+    //every worker binds the same port, the kernel spreads flows across them by their address hash
+    if (opts->workers > 1) {
+        int reuse = 1;
+        if (setsockopt(opts->sock_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) == -1) {
+            opts->msg = strdup("SO_REUSEPORT failed\n");
+            return -1;
+        }
+    }
+
+    addr.sin_family = opts->ip_family;
+    addr.sin_port = htons(opts->host_port);
+    addr.sin_addr.s_addr = inet_addr(opts->host_ip);
+    if (addr.sin_addr.s_addr == (in_addr_t) -1) {
+        opts->msg = strdup("inet_addr failed\n");
+        return -1;
+    }
+
+    ret = bind(opts->sock_fd, (struct sockaddr *) &addr, sizeof(struct sockaddr_in));
+    if (ret == -1) {
+        opts->msg = strdup("bind failed\n");
+        return -1;
     }
-    opts->window[0].seq_num = UINT32_MAX;
+
+    return set_socket_non_block(opts);
 }
 
-void init_graphing(struct server_opts *opts)
+int init_graphing(struct server_opts *opts)
 {
-    opts->graph_fd = fopen("./graph.txt", "w");
+    opts->graph_stats = open_stat_writer(opts->stat_format == STAT_BINARY ? "./graph.bin" : "./graph.txt",
+                                      opts->stat_format);
     opts->stat_fd = fopen("./stat.txt", "w");
     opts->start_time = time(0);
+    if(opts->graph_stats == NULL || opts->stat_fd == NULL)
+    {
+        opts->msg = strdup("failed to open stats files\n");
+        return -1;
+    }
+    return 0;
 }
 
 int set_socket_non_block(struct server_opts *opts)
@@ -198,125 +354,245 @@ int set_socket_non_block(struct server_opts *opts)
     return 0;
 }
 
-void handle_data_in(struct server_opts *opts, char *buffer, uint32_t *client_seq_num, uint32_t *server_seq_num
-        , struct stash *window, struct sockaddr *from_addr, socklen_t *from_addr_len)
+void size_receive_buffer(struct server_opts *opts, size_t datagram_len)
 {
-    struct packet *pkt = malloc(sizeof(struct packet));
-    pkt->header = malloc(sizeof(struct packet_header));
-    deserialize_packet(buffer, pkt);
+    //room for a full window of the largest datagrams, the kernel charges about twice their length for each
+    size_t wanted = (size_t)opts->win_size * datagram_len * 2;
+    int size = wanted < INT32_MAX ? (int)wanted : INT32_MAX;
+    int current;
+    socklen_t len = sizeof(current);
 
-    if(pkt->header->seq_num < *client_seq_num)
+    if(getsockopt(opts->sock_fd, SOL_SOCKET, SO_RCVBUF, &current, &len) == 0 && current >= size)
     {
-        //RETURN ACK
-        return_ack(opts->sock_fd, server_seq_num, pkt->header->seq_num, from_addr, from_addr_len);
-        //IGNORE PACKET
-        write_to_graph(opts->graph_fd, pkt->header->seq_num, opts->start_time);
-
+        return;
     }
-    else if(pkt->header->seq_num >= *client_seq_num && pkt->header->seq_num < *client_seq_num+WIN_SIZE)
+    //capped by the system limit, a smaller queue only costs drops the client recovers from
+    if(setsockopt(opts->sock_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) == -1)
     {
-        //RETURN ACK
-        return_ack(opts->sock_fd, server_seq_num, pkt->header->seq_num, from_addr, from_addr_len);
-        //STASH AND DELIVER LOGIC
-        manage_window(client_seq_num, window, pkt);
-        write_to_graph(opts->graph_fd, pkt->header->seq_num, opts->start_time);
+        perror("SO_RCVBUF");
+    }
+}
 
+int handle_data_in(struct server_opts *opts, struct session *session, char *buffer, size_t len, uint32_t buf,
+                   struct sockaddr *from_addr, socklen_t *from_addr_len)
+{
+    struct packet_header header;
+    struct packet pkt;
+
+    //runt datagram, too short to hold a header
+    if(len < HEADER_LEN)
+    {
+        return 0;
     }
 
-    free_pkt(pkt);
+    session->packets_received++;
+    session->bytes_received += len;
 
-}
+    pkt.header = &header;
+    deserialize_packet(buffer, len, &pkt);
 
-void manage_window(uint32_t *client_seq_num, struct stash *window, struct packet *pkt)
-{
-    uint32_t pkt_seq_num;
-
-    //store_packet
-    pkt_seq_num = pkt->header->seq_num - *client_seq_num;
-    window[pkt_seq_num].cleared = 1;
-    window[pkt_seq_num].rel_num = pkt_seq_num;
-    window[pkt_seq_num].seq_num = pkt->header->seq_num;
-    window[pkt_seq_num].data = strdup(pkt->data); //malloc
-    //check_window
-    check_window(client_seq_num, window);
-    //order_window
-    order_window(client_seq_num, window);
+    //a path MTU probe numbers its own sequence, it only needs an answer
+    if(pkt.header->flags & PROBE)
+    {
+        //the sender names its payload size in the ack field once its search is over
+        if(pkt.header->ack_num > 0 && pkt.header->ack_num <= MAX_DATAGRAM_LEN - HEADER_LEN - TRAILER_LEN)
+        {
+            session->payload_len = pkt.header->ack_num;
+        }
+        return_probe_ack(opts->ack_batch, &session->server_seq_num, pkt.header->seq_num, session->window, from_addr,
+                         from_addr_len);
+        return 0;
+    }
+
+    //parity only feeds recovery, the sender neither counts it in flight nor waits for an ack
+    if(pkt.header->flags & FEC)
+    {
+        fec_receive_parity(opts, session, &pkt, len, from_addr, from_addr_len);
+        return 0;
+    }
+
+    return accept_packet(opts, session, &pkt, len, buf, from_addr, from_addr_len);
 }
 
-void check_window(uint32_t *client_seq_num, struct stash *window)
+int accept_packet(struct server_opts *opts, struct session *session, struct packet *pkt, size_t len, uint32_t buf,
+                  struct sockaddr *from_addr, socklen_t *from_addr_len)
 {
-    for(size_t i = 0; i < WIN_SIZE; i++)
+    struct packet received = *pkt;
+    uint32_t *client_seq_num = &session->client_seq_num;
+    uint32_t *server_seq_num = &session->server_seq_num;
+    struct reorder_window *window = session->window;
+    uint32_t win_size = opts->win_size;
+    int stashed = 0;
+    int held = 0;
+
+    if(pkt->header->seq_num < *client_seq_num)
     {
-        if(window[i].seq_num == *client_seq_num)
+        //RETURN ACK, at once so a sender retransmitting what already arrived learns it quickly
+        return_ack(opts->ack_batch, server_seq_num, pkt->header->seq_num, *client_seq_num, window, from_addr,
+                   from_addr_len);
+        session->acks_owed = 0;
+        //IGNORE PACKET
+        write_to_graph(opts->graph_stats, pkt->header->seq_num, opts->start_time);
+
+    }
+    else if(pkt->header->seq_num >= *client_seq_num && pkt->header->seq_num < *client_seq_num+win_size)
+    {
+        uint32_t expected = *client_seq_num;
+        int fresh = !window_holds(window, pkt->header->seq_num);
+
+        //STASH AND DELIVER LOGIC, or straight to its place in the file
+        if(opts->sink_type == SINK_POSITIONAL)
         {
-            deliver_data(window[i].data, window[i].seq_num);
-            reset_stash(&window[i]);
-            (*client_seq_num)++;
-//            printf("expected seq_num: %d\n", *client_seq_num);
+            held = place_packet(opts->sink, client_seq_num, window, pkt, session->payload_len);
         }
         else
         {
-            break;
+            held = manage_window(opts->pool, opts->sink, client_seq_num, window, pkt, buf);
+            stashed = held == 1;
+        }
+        //nowhere to keep it, no ack so the sender retransmits
+        if(held == -1)
+        {
+            write_to_graph(opts->graph_stats, pkt->header->seq_num, opts->start_time);
+            return 0;
         }
+        //folded into its group's parity once it is really in, from the bytes as they arrived
+        if(session->fec != NULL && fresh &&
+           (pkt->header->seq_num < *client_seq_num || window_holds(window, pkt->header->seq_num)))
+        {
+            fec_record_packet(opts, session, &received, len, from_addr, from_addr_len);
+        }
+        //RETURN ACK, after stashing so the selective ack includes this packet
+        if(pkt->header->seq_num == expected && *client_seq_num == expected + 1 && window->held == 0)
+        {
+            //in order with no gap anywhere, it can share an ack with the packets after it
+            delay_ack(opts, session, pkt->header->seq_num, from_addr, from_addr_len);
+        }
+        else
+        {
+            //out of order, a duplicate, or filling a gap, the sender hears about it straight away
+            return_ack(opts->ack_batch, server_seq_num, pkt->header->seq_num, *client_seq_num, window, from_addr,
+                       from_addr_len);
+            session->acks_owed = 0;
+        }
+        write_to_graph(opts->graph_stats, pkt->header->seq_num, opts->start_time);
+
     }
+
+    return stashed;
 }
 
-void order_window(const uint32_t *client_seq_num, struct stash *window)
+int manage_window(struct buffer_pool *pool, struct delivery_sink *sink, uint32_t *client_seq_num,
+                  struct reorder_window *window, struct packet *pkt, uint32_t buf)
 {
-    //order window
-    for(size_t i = 0; i < WIN_SIZE; i++)
+    struct stash *slot;
+    int stashed = 1;
+
+    //a retransmission of a packet already held, keep the first copy
+    if(window_holds(window, pkt->header->seq_num))
     {
-        if(window[i].cleared == 1)
+        return 0;
+    }
+    //the datagram shares its buffer with others, so the payload gets a buffer of its own
+    if(buf == POOL_NONE)
+    {
+        //larger than any size the sender probed for, so it cannot be held
+        if(pkt->data_len > pool->buf_len)
         {
-            uint32_t new_rel = window[i].seq_num - *client_seq_num;
-            if(new_rel != i)
-            {
-                window[new_rel].rel_num = new_rel;
-                copy_stash(&window[i], &window[new_rel]);
-                reset_stash(&window[i]);
-            }
+            return -1;
+        }
+        buf = pool_acquire(pool);
+        if(buf == POOL_NONE)
+        {
+            return -1;
         }
+        memcpy(pool_buffer(pool, buf), pkt->data, pkt->data_len);
+        pkt->data = pool_buffer(pool, buf);
+        stashed = 0;
     }
 
+    //store_packet, straight into its slot of the ring
+    slot = &window->slots[pkt->header->seq_num & window->mask];
+    slot->seq_num = pkt->header->seq_num;
+    slot->buf = buf;
+    slot->data_len = (uint16_t)pkt->data_len;
+    slot->data = pkt->data;
+    window_mark(window, pkt->header->seq_num);
+    //check_window, only the expected packet can release anything
+    if(pkt->header->seq_num == *client_seq_num)
+    {
+        check_window(sink, client_seq_num, window);
+    }
+    return stashed;
 }
 
-void print_window(struct stash *window)
+void check_window(struct delivery_sink *sink, uint32_t *client_seq_num, struct reorder_window *window)
 {
-    printf("-----------------------WINDOW INFO-----------------------\n");
-    for(size_t i = 0; i < WIN_SIZE; ++i)
+    //the run of held packets from the expected one is delivered together
+    uint32_t run = window_run(window, *client_seq_num, window->win_size, 1);
+
+    for(uint32_t i = 0; i < run; i++)
     {
-        printf("----SLOT %zu----\n", i);
-        printf("Cleared: %d\n", window[i].cleared);
-        printf("Rel_num: %d\n", window[i].rel_num);
-        printf("Seq_num: %d\n", window[i].seq_num);
+        //the sink takes over the buffer
+        deliver_data(sink, &window->slots[(*client_seq_num + i) & window->mask]);
     }
-
+    window_clear_run(window, *client_seq_num, run);
+    *client_seq_num += run;
 }
 
-void copy_stash(const struct stash *src, struct stash *dest)
+int place_packet(struct delivery_sink *sink, uint32_t *client_seq_num, struct reorder_window *window,
+                 const struct packet *pkt, uint32_t block_len)
 {
-    dest->cleared = src->cleared;
-    dest->seq_num = src->seq_num;
-    dest->data = strdup(src->data);
+    uint32_t run;
+
+    //already in the file
+    if(window_holds(window, pkt->header->seq_num))
+    {
+        return 0;
+    }
+
+    if(write_at_offset(sink, pkt->header->seq_num, block_len, pkt->data, pkt->data_len) == -1)
+    {
+        //left unmarked, the retransmission gets another try
+        return -1;
+    }
+
+    //only the completion bit is kept, the expected packet moves the window past the run already written
+    window_mark(window, pkt->header->seq_num);
+    if(pkt->header->seq_num == *client_seq_num)
+    {
+        run = window_run(window, *client_seq_num, window->win_size, 1);
+        window_clear_run(window, *client_seq_num, run);
+        *client_seq_num += run;
+    }
+    return 0;
 }
 
-void deliver_data(char *data, uint32_t seq_num)
+void print_window(const struct reorder_window *window, uint32_t client_seq_num)
 {
-    printf("Client %d: %s\n", seq_num, data);
+    printf("-----------------------WINDOW INFO-----------------------\n");
+    for(uint32_t i = 0; i < window->win_size; ++i)
+    {
+        if(window_holds(window, client_seq_num + i))
+        {
+            printf("----SLOT %u----\n", (client_seq_num + i) & window->mask);
+            printf("Seq_num: %u\n", window->slots[(client_seq_num + i) & window->mask].seq_num);
+        }
+    }
+
 }
 
-void reset_stash(struct stash *stash)
+void reset_stash(struct buffer_pool *pool, struct stash *stash)
 {
-    stash->cleared = 0;
-    stash->rel_num = 0;
     stash->seq_num = 0;
     if(stash->data)
     {
-        free(stash->data);
+        pool_release(pool, stash->buf);
+        stash->data = NULL;
     }
 }
 
-void deserialize_packet(char *header, struct packet *pkt)
+void deserialize_packet(char *header, size_t len, struct packet *pkt)
 {
     size_t count;
     count = 0;
@@ -333,47 +609,102 @@ void deserialize_packet(char *header, struct packet *pkt)
     pkt->header->ack_num = ntohl(pkt->header->ack_num);
     pkt->header->data_len = ntohs(pkt->header->data_len);
 
-    pkt->data = strndup(&header[count], pkt->header->data_len);
+    //never read past the end of the datagram, a coalesced buffer continues with the next one
+    pkt->data = &header[count];
+    //the exact length from the header, binary payloads carry NUL bytes of their own
+    pkt->data_len = pkt->header->data_len < len - count ? pkt->header->data_len : len - count;
+    pkt->data_len = pkt->data_len > TRAILER_LEN ? pkt->data_len - TRAILER_LEN : 0;
+}
+
+void return_ack(struct ack_batch *acks, uint32_t *server_seq_num, uint32_t pkt_seq_num, uint32_t client_seq_num,
+                const struct reorder_window *window, struct sockaddr *from_addr, const socklen_t *from_addr_len)
+{
+    char *ack;
+    size_t ack_len;
+    struct sack_block blocks[SACK_MAX_BLOCKS];
+    uint8_t block_count;
+
+    //queued, the whole batch of acks is sent once the received batch is handled
+    ack = next_ack(acks, from_addr, *from_addr_len);
+
+    block_count = collect_sack_blocks(client_seq_num, window, blocks);
+    ack_len = generate_ack(ack, *server_seq_num, pkt_seq_num, ACK | SACK, window->win_size, client_seq_num, blocks, block_count);
+    commit_ack(acks, ack_len);
+//    printf("Sent ack for packet %d\n", pkt_seq_num);
+    (*server_seq_num)++;
 }
 
-void free_pkt(struct packet *pkt)
+void delay_ack(struct server_opts *opts, struct session *session, uint32_t pkt_seq_num, struct sockaddr *from_addr,
+               socklen_t *from_addr_len)
 {
-    if(pkt != NULL)
+    session->owed_seq_num = pkt_seq_num;
+    if(++session->acks_owed >= opts->ack_every)
     {
-        if(pkt->header != NULL)
-        {
-//            printf("freeing header\n");
-            free(pkt->header);
-        }
-        if(pkt->data != NULL)
-        {
-//            printf("freeing data\n");
-            free(pkt->data);
-        }
+        //the cumulative ack covers every packet owed
+        return_ack(opts->ack_batch, &session->server_seq_num, pkt_seq_num, session->client_seq_num, session->window,
+                   from_addr, from_addr_len);
+        session->acks_owed = 0;
+        return;
+    }
+
+    //one deadline for the worker, whichever session first owes an ack sets it
+    if(opts->ack_deadline == 0)
+    {
+        opts->ack_deadline = monotonic_usec() + ACK_DELAY_US;
     }
 }
 
-void return_ack(int sock_fd, uint32_t *server_seq_num, uint32_t pkt_seq_num,
-                struct sockaddr *from_addr, const socklen_t *from_addr_len)
+void return_probe_ack(struct ack_batch *acks, uint32_t *server_seq_num, uint32_t probe_seq_num,
+                      const struct reorder_window *window, struct sockaddr *from_addr, const socklen_t *from_addr_len)
 {
     char *ack;
+    size_t ack_len;
 
-    ack = malloc(ACK_SIZE);
-
-    generate_ack(ack, *server_seq_num, pkt_seq_num, ACK, ACK_DATA_LEN);
-    sendto(sock_fd, ack, ACK_SIZE, 0, from_addr, *from_addr_len);
-//    printf("Sent ack for packet %d\n", pkt_seq_num);
+    //the probe's own number echoed back is all the sender needs to know its size got through
+    ack = next_ack(acks, from_addr, *from_addr_len);
+    ack_len = generate_ack(ack, *server_seq_num, probe_seq_num, ACK | PROBE, window->win_size, 0, NULL, 0);
+    commit_ack(acks, ack_len);
     (*server_seq_num)++;
-    free(ack);
 }
 
-void generate_ack(char *ack, uint32_t server_seq_num, uint32_t pkt_seq_num, uint8_t flags, uint16_t data_len)
+uint8_t collect_sack_blocks(uint32_t client_seq_num, const struct reorder_window *window, struct sack_block *blocks)
+{
+    uint8_t block_count = 0;
+    uint32_t i = 0;
+
+    //alternate runs of missing and held packets across the window, a bitmap word at a time
+    while(i < window->win_size && block_count < SACK_MAX_BLOCKS)
+    {
+        i += window_run(window, client_seq_num + i, window->win_size - i, 0);
+        if(i == window->win_size)
+        {
+            break;
+        }
+        blocks[block_count].start = client_seq_num + i;
+        i += window_run(window, client_seq_num + i, window->win_size - i, 1);
+        blocks[block_count].end = client_seq_num + i;
+        block_count++;
+    }
+
+    return block_count;
+}
+
+size_t generate_ack(char *ack, uint32_t server_seq_num, uint32_t pkt_seq_num, uint8_t flags, uint32_t win_size,
+                    uint32_t cum_ack, const struct sack_block *blocks, uint8_t block_count)
 {
     size_t count;
+    uint16_t data_len;
+
+    data_len = ACK_DATA_LEN;
+    if(flags & SACK)
+    {
+        data_len += (uint16_t)(sizeof(uint32_t) + sizeof(uint8_t) + block_count * SACK_BLOCK_SIZE);
+    }
 
     server_seq_num = htonl(server_seq_num);
     pkt_seq_num = htonl(pkt_seq_num);
     data_len = htons(data_len);
+    win_size = htonl(win_size);
 
     count = 0;
     memcpy(&ack[count], &server_seq_num, sizeof(uint32_t));
@@ -384,10 +715,33 @@ void generate_ack(char *ack, uint32_t server_seq_num, uint32_t pkt_seq_num, uint
     count += sizeof(uint8_t);
     memcpy(&ack[count], &data_len, sizeof(uint16_t));
     count += sizeof(uint16_t);
+    //advertise the receive window so the sender never runs past it
+    memcpy(&ack[count], &win_size, sizeof(uint32_t));
+    count += sizeof(uint32_t);
+    if(flags & SACK)
+    {
+        //cumulative ack (next expected sequence number) followed by the blocks held above it
+        cum_ack = htonl(cum_ack);
+        memcpy(&ack[count], &cum_ack, sizeof(uint32_t));
+        count += sizeof(uint32_t);
+        memcpy(&ack[count], &block_count, sizeof(uint8_t));
+        count += sizeof(uint8_t);
+        for(uint8_t i = 0; i < block_count; ++i)
+        {
+            uint32_t start = htonl(blocks[i].start);
+            uint32_t end = htonl(blocks[i].end);
+            memcpy(&ack[count], &start, sizeof(uint32_t));
+            count += sizeof(uint32_t);
+            memcpy(&ack[count], &end, sizeof(uint32_t));
+            count += sizeof(uint32_t);
+        }
+    }
     strncpy(&ack[count], "\3", 1);
     count++;
     strncpy(&ack[count], "\3", 1);
+    count++;
 
+    return count;
 }
 
 int print_error(void *arg)
@@ -406,6 +760,16 @@ int clean_up(void *arg)
         free(opts->msg);
     }
 
+    stop_workers(opts);
+    close_stat_writer(opts->graph_stats);
+    opts->graph_stats = NULL;
+    free_batches(opts);
+    close_events(opts);
+    free_sessions(opts);
+    free_sink(opts);
+    free_buffer_pool(opts);
+    close_sink_output(opts);
+
     if(opts->running != 0)
     {
         close(opts->sock_fd);
@@ -416,12 +780,17 @@ int clean_up(void *arg)
         }
         if(opts->running != 1)
         {
-            write_to_stat(opts->stat_fd, opts->server_seq_num, opts->client_seq_num);
-            fclose(opts->graph_fd);
-            fclose(opts->stat_fd);
+            write_to_stat(opts->stat_fd, opts->total_server_seq_num, opts->total_client_seq_num);
         }
     }
 
+    //opened whether or not the graph runs
+    if(opts->stat_fd)
+    {
+        fclose(opts->stat_fd);
+        opts->stat_fd = NULL;
+    }
+
     if(opts->graph_pid != 0)
     {
         waitpid(opts->graph_pid, NULL, 0);
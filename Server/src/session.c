@@ -0,0 +1,308 @@
+#include "session.h"
+#include "helpers.h"
+#include "window.h"
+#include "sink.h"
+#include "fec.h"
+#include <netinet/in.h>
+
+static size_t session_key(const struct sockaddr *addr, uint8_t *key);
+static uint32_t hash_key(const uint8_t *key, size_t key_len);
+static int grow_table(struct session_table *table);
+static void remove_session(struct session_table *table, struct buffer_pool *pool, size_t index);
+static void write_session_stat(FILE *stat, const struct session *session);
+
+int init_sessions(struct server_opts *opts)
+{
+    opts->sessions = calloc(1, sizeof(struct session_table));
+    if(opts->sessions == NULL)
+    {
+        opts->msg = strdup("session table allocation failed\n");
+        return -1;
+    }
+
+    opts->sessions->slots = calloc(SESSION_TABLE_SIZE, sizeof(struct session));
+    if(opts->sessions->slots == NULL)
+    {
+        opts->msg = strdup("session table allocation failed\n");
+        return -1;
+    }
+    opts->sessions->capacity = SESSION_TABLE_SIZE;
+    opts->sessions->win_size = opts->win_size;
+    opts->sessions->hold_packets = opts->sink_type != SINK_POSITIONAL;
+    return 0;
+}
+
+static size_t session_key(const struct sockaddr *addr, uint8_t *key)
+{
+    //address then port, so two senders behind one host stay apart
+    if(addr->sa_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *) addr;
+        memcpy(key, &addr6->sin6_addr, sizeof(addr6->sin6_addr));
+        memcpy(&key[sizeof(addr6->sin6_addr)], &addr6->sin6_port, sizeof(addr6->sin6_port));
+        return sizeof(addr6->sin6_addr) + sizeof(addr6->sin6_port);
+    }
+
+    const struct sockaddr_in *addr4 = (const struct sockaddr_in *) addr;
+    memcpy(key, &addr4->sin_addr, sizeof(addr4->sin_addr));
+    memcpy(&key[sizeof(addr4->sin_addr)], &addr4->sin_port, sizeof(addr4->sin_port));
+    return sizeof(addr4->sin_addr) + sizeof(addr4->sin_port);
+}
+
+static uint32_t hash_key(const uint8_t *key, size_t key_len)
+{
+    //FNV-1a
+    uint32_t hash = 2166136261u;
+
+    for(size_t i = 0; i < key_len; ++i)
+    {
+        hash ^= key[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int grow_table(struct session_table *table)
+{
+    size_t capacity = table->capacity * 2;
+    struct session *slots = calloc(capacity, sizeof(struct session));
+
+    if(slots == NULL)
+    {
+        return -1;
+    }
+
+    //sessions keep their windows, only their slots move
+    for(size_t i = 0; i < table->capacity; ++i)
+    {
+        if(table->slots[i].in_use)
+        {
+            size_t index = table->slots[i].hash & (capacity - 1);
+            while(slots[index].in_use)
+            {
+                index = (index + 1) & (capacity - 1);
+            }
+            slots[index] = table->slots[i];
+        }
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    return 0;
+}
+
+struct session *find_session(struct session_table *table, const struct sockaddr *addr, socklen_t addr_len)
+{
+    uint8_t key[SESSION_KEY_LEN];
+    size_t key_len = session_key(addr, key);
+    uint32_t hash = hash_key(key, key_len);
+    size_t mask = table->capacity - 1;
+    size_t index;
+    struct session *session;
+
+    //linear probing, the run ends at the first empty slot
+    for(index = hash & mask; table->slots[index].in_use; index = (index + 1) & mask)
+    {
+        session = &table->slots[index];
+        if(session->hash == hash && session->key_len == key_len && memcmp(session->key, key, key_len) == 0)
+        {
+            //back from idle, the window was given up but the sequence numbers carry on from where they stopped
+            if(session->window == NULL)
+            {
+                session->window = alloc_window(table->win_size, table->hold_packets);
+                if(session->window == NULL)
+                {
+                    return NULL;
+                }
+            }
+            session->last_seen = time(0);
+            return session;
+        }
+    }
+
+    //new peer, keep the table at most half full so probe runs stay short
+    if((table->count + 1) * 2 > table->capacity)
+    {
+        if(grow_table(table) == -1)
+        {
+            return NULL;
+        }
+        mask = table->capacity - 1;
+        for(index = hash & mask; table->slots[index].in_use; index = (index + 1) & mask)
+        {
+        }
+    }
+
+    session = &table->slots[index];
+    memset(session, 0, sizeof(struct session));
+    session->window = alloc_window(table->win_size, table->hold_packets);
+    session->payload_len = FILE_BLOCK_LEN;
+    if(session->window == NULL)
+    {
+        return NULL;
+    }
+    session->in_use = 1;
+    session->key_len = (uint8_t) key_len;
+    memcpy(session->key, key, key_len);
+    session->hash = hash;
+    memcpy(&session->peer, addr, addr_len < sizeof(session->peer) ? addr_len : sizeof(session->peer));
+    session->last_seen = time(0);
+    table->count++;
+    return session;
+}
+
+static void remove_session(struct session_table *table, struct buffer_pool *pool, size_t index)
+{
+    size_t mask = table->capacity - 1;
+    size_t next;
+
+    //the held buffers go back to the pool with the window
+    if(table->slots[index].window)
+    {
+        free_window(pool, table->slots[index].window);
+    }
+    free_fec_decoder(table->slots[index].fec);
+    table->slots[index].in_use = 0;
+    table->count--;
+
+    //backward shift deletion, pull later entries of the run into the hole so lookups never stop early
+    for(next = (index + 1) & mask; table->slots[next].in_use; next = (next + 1) & mask)
+    {
+        size_t home = table->slots[next].hash & mask;
+
+        //leave entries whose home lies cyclically between the hole and where they sit
+        if(((next - home) & mask) < ((next - index) & mask))
+        {
+            continue;
+        }
+        table->slots[index] = table->slots[next];
+        table->slots[next].in_use = 0;
+        index = next;
+    }
+}
+
+static void write_session_stat(FILE *stat, const struct session *session)
+{
+    char peer[INET6_ADDRSTRLEN] = "";
+    in_port_t port;
+
+    if(session->peer.ss_family == AF_INET6)
+    {
+        const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *) &session->peer;
+        inet_ntop(AF_INET6, &addr6->sin6_addr, peer, sizeof(peer));
+        port = ntohs(addr6->sin6_port);
+    }
+    else
+    {
+        const struct sockaddr_in *addr4 = (const struct sockaddr_in *) &session->peer;
+        inet_ntop(AF_INET, &addr4->sin_addr, peer, sizeof(peer));
+        port = ntohs(addr4->sin_port);
+    }
+
+    //workers share the file, keep each session's lines together
+    flockfile(stat);
+    fprintf(stat, "Client %s:%hu\n", peer, port);
+    write_to_stat(stat, session->server_seq_num, session->client_seq_num);
+    funlockfile(stat);
+}
+
+void evict_idle_sessions(struct server_opts *opts, time_t now)
+{
+    struct session_table *table = opts->sessions;
+    size_t i = 0;
+
+    while(i < table->capacity)
+    {
+        struct session *session = &table->slots[i];
+
+        if(!session->in_use)
+        {
+            i++;
+            continue;
+        }
+        //long gone, the slot and anything still held go with it
+        if(now - session->last_seen >= SESSION_EXPIRE_TIMEOUT)
+        {
+            if(opts->running == 2)
+            {
+                write_session_stat(opts->stat_fd, session);
+            }
+            opts->total_client_seq_num += session->client_seq_num;
+            opts->total_server_seq_num += session->server_seq_num;
+            //the shift may pull an unvisited entry into this slot, so look at it again
+            remove_session(table, opts->pool, i);
+            continue;
+        }
+        i++;
+
+        if(session->window == NULL || now - session->last_seen < SESSION_IDLE_TIMEOUT)
+        {
+            continue;
+        }
+        //packets held above a gap are already acked, the sender only resends the gap, so they stay
+        if(session->window->held > 0 || session->acks_owed > 0)
+        {
+            continue;
+        }
+        //only the memory goes, the sequence numbers stay so a sender that pauses picks up where it left off
+        free_window(opts->pool, session->window);
+        session->window = NULL;
+        free_fec_decoder(session->fec);
+        session->fec = NULL;
+    }
+}
+
+void send_delayed_acks(struct server_opts *opts)
+{
+    struct session_table *table = opts->sessions;
+
+    //every owed ack goes, those owed only briefly just go a little early
+    for(size_t i = 0; i < table->capacity; ++i)
+    {
+        struct session *session = &table->slots[i];
+        socklen_t peer_len;
+
+        if(!session->in_use || session->acks_owed == 0)
+        {
+            continue;
+        }
+        peer_len = session->peer.ss_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+        return_ack(opts->ack_batch, &session->server_seq_num, session->owed_seq_num, session->client_seq_num,
+                   session->window, (struct sockaddr *) &session->peer, &peer_len);
+        session->acks_owed = 0;
+    }
+    opts->ack_deadline = 0;
+}
+
+void free_sessions(struct server_opts *opts)
+{
+    struct session_table *table = opts->sessions;
+
+    if(table == NULL)
+    {
+        return;
+    }
+
+    for(size_t i = 0; i < table->capacity; ++i)
+    {
+        if(table->slots[i].in_use)
+        {
+            if(opts->running == 2)
+            {
+                write_session_stat(opts->stat_fd, &table->slots[i]);
+            }
+            opts->total_client_seq_num += table->slots[i].client_seq_num;
+            opts->total_server_seq_num += table->slots[i].server_seq_num;
+            if(table->slots[i].window)
+            {
+                free_window(opts->pool, table->slots[i].window);
+            }
+            free_fec_decoder(table->slots[i].fec);
+        }
+    }
+
+    free(table->slots);
+    free(table);
+    opts->sessions = NULL;
+}
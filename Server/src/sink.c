@@ -0,0 +1,246 @@
+#include "sink.h"
+#include "pool.h"
+
+static void release_batch(struct delivery_sink *sink);
+
+int parse_sink(struct server_opts *opts, const char *arg)
+{
+    //anything that is not a keyword names the output file
+    if(strcmp(arg, "print") == 0)
+    {
+        opts->sink_type = SINK_PRINT;
+    }
+    else if(strcmp(arg, "stdout") == 0)
+    {
+        opts->sink_type = SINK_STDOUT;
+    }
+    else if(strcmp(arg, "discard") == 0)
+    {
+        opts->sink_type = SINK_DISCARD;
+    }
+    else if(*arg != '\0')
+    {
+        if(opts->sink_path)
+        {
+            free(opts->sink_path);
+        }
+        opts->sink_type = SINK_FILE;
+        opts->sink_path = strdup(arg);
+    }
+    else
+    {
+        opts->msg = strdup("Delivery must be print, stdout, discard or a file path.\n");
+        return -1;
+    }
+    return 0;
+}
+
+int parse_receive_file(struct server_opts *opts, const char *arg)
+{
+    if(*arg == '\0')
+    {
+        opts->msg = strdup("Receive file path must not be empty.\n");
+        return -1;
+    }
+
+    if(opts->sink_path)
+    {
+        free(opts->sink_path);
+    }
+    opts->sink_type = SINK_POSITIONAL;
+    opts->sink_path = strdup(arg);
+    return 0;
+}
+
+int open_sink_output(struct server_opts *opts)
+{
+    opts->sink_fd = -1;
+
+    if(opts->sink_type == SINK_POSITIONAL)
+    {
+        opts->sink_fd = open(opts->sink_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(opts->sink_fd == -1)
+        {
+            opts->msg = strdup("failed to open receive file\n");
+            return -1;
+        }
+        printf("Receive File: %s\n", opts->sink_path);
+    }
+    else if(opts->sink_type == SINK_FILE)
+    {
+        opts->sink_fd = open(opts->sink_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if(opts->sink_fd == -1)
+        {
+            opts->msg = strdup("failed to open delivery file\n");
+            return -1;
+        }
+        printf("Delivery: %s\n", opts->sink_path);
+    }
+    else if(opts->sink_type == SINK_STDOUT)
+    {
+        //keep the payload stream clean, everything printf'd from here on lands on stderr
+        opts->sink_fd = dup(STDOUT_FILENO);
+        if(opts->sink_fd == -1 || dup2(STDERR_FILENO, STDOUT_FILENO) == -1)
+        {
+            opts->msg = strdup("failed to redirect stdout\n");
+            return -1;
+        }
+        printf("Delivery: stdout\n");
+    }
+    else if(opts->sink_type == SINK_DISCARD)
+    {
+        printf("Delivery: discard\n");
+    }
+    return 0;
+}
+
+void close_sink_output(struct server_opts *opts)
+{
+    if(opts->sink_fd > 0)
+    {
+        close(opts->sink_fd);
+        opts->sink_fd = -1;
+    }
+    if(opts->sink_path)
+    {
+        free(opts->sink_path);
+        opts->sink_path = NULL;
+    }
+}
+
+int init_sink(struct server_opts *opts)
+{
+    //every worker batches on its own, they share the output descriptor
+    opts->sink = calloc(1, sizeof(struct delivery_sink));
+    if(opts->sink == NULL)
+    {
+        opts->msg = strdup("sink allocation failed\n");
+        return -1;
+    }
+    opts->sink->type = opts->sink_type;
+    opts->sink->fd = opts->sink_fd;
+    opts->sink->pool = opts->pool;
+    return 0;
+}
+
+void free_sink(struct server_opts *opts)
+{
+    if(opts->sink)
+    {
+        flush_sink(opts->sink);
+        free(opts->sink);
+        opts->sink = NULL;
+    }
+}
+
+void deliver_data(struct delivery_sink *sink, struct stash *stash)
+{
+    switch(sink->type)
+    {
+        case SINK_STDOUT:
+        case SINK_FILE:
+            //the buffer is written in place later, it goes back to the pool after that
+            if(sink->count == SINK_BATCH_SIZE)
+            {
+                flush_sink(sink);
+            }
+            sink->iovecs[sink->count].iov_base = stash->data;
+            sink->iovecs[sink->count].iov_len = stash->data_len;
+            sink->bufs[sink->count] = stash->buf;
+            sink->count++;
+            stash->data = NULL;
+            return;
+        case SINK_PRINT:
+            //printed as text, so it stops at the first NUL the way the original output did
+            printf("Client %d: %.*s\n", stash->seq_num, (int)strnlen(stash->data, stash->data_len), stash->data);
+            break;
+        default:
+            break;
+    }
+    reset_stash(sink->pool, stash);
+}
+
+void flush_sink(struct delivery_sink *sink)
+{
+    struct iovec *iov = sink->iovecs;
+    int remaining = (int)sink->count;
+
+    //one writev for the run of payloads, picking up after a short write to a pipe
+    while(remaining > 0)
+    {
+        ssize_t written = writev(sink->fd, iov, remaining);
+
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("writev");
+            break;
+        }
+        while(remaining > 0 && (size_t)written >= iov->iov_len)
+        {
+            written -= (ssize_t)iov->iov_len;
+            iov++;
+            remaining--;
+        }
+        if(remaining > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + written;
+            iov->iov_len -= (size_t)written;
+        }
+    }
+
+    release_batch(sink);
+}
+
+int write_at_offset(struct delivery_sink *sink, uint32_t seq_num, uint32_t block_len, const char *data, size_t data_len)
+{
+    //every packet before this one carried a full block, so its place in the file follows from its number
+    off_t offset = (off_t)seq_num * block_len;
+    size_t written = 0;
+
+#ifdef __linux__
+    //reserve extents well ahead so the file is not grown a block at a time, the size still follows the writes
+    if(sink->reserved >= 0 && offset + (off_t)data_len > sink->reserved)
+    {
+        off_t start = sink->reserved > offset ? sink->reserved : offset;
+        if(fallocate(sink->fd, FALLOC_FL_KEEP_SIZE, start, FILE_PREALLOC_LEN) == 0)
+        {
+            sink->reserved = start + FILE_PREALLOC_LEN;
+        }
+        else
+        {
+            //unsupported by the file system, plain writes still work
+            sink->reserved = -1;
+        }
+    }
+#endif
+
+    while(written < data_len)
+    {
+        ssize_t ret = pwrite(sink->fd, data + written, data_len - written, offset + (off_t)written);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("pwrite");
+            return -1;
+        }
+        written += (size_t)ret;
+    }
+    return 0;
+}
+
+static void release_batch(struct delivery_sink *sink)
+{
+    for(unsigned int i = 0; i < sink->count; ++i)
+    {
+        pool_release(sink->pool, sink->bufs[i]);
+    }
+    sink->count = 0;
+}
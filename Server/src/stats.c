@@ -0,0 +1,223 @@
+#include "stats.h"
+#include <time.h>
+
+static void *stat_writer_main(void *arg);
+static size_t drain_stats(struct stat_writer *writer);
+static size_t format_stat(const struct stat_writer *writer, const struct stat_slot *slot, char *out);
+static void write_all(int fd, const char *buffer, size_t len);
+
+int parse_stat_format(struct server_opts *opts, const char *arg)
+{
+    if(strcmp(arg, "csv") == 0)
+    {
+        opts->stat_format = STAT_CSV;
+    }
+    else if(strcmp(arg, "binary") == 0)
+    {
+        opts->stat_format = STAT_BINARY;
+    }
+    else
+    {
+        opts->msg = strdup("Stats format must be csv or binary.\n");
+        return -1;
+    }
+    return 0;
+}
+
+struct stat_writer *open_stat_writer(const char *path, int format)
+{
+    struct stat_writer *writer = calloc(1, sizeof(struct stat_writer));
+
+    if(writer == NULL)
+    {
+        return NULL;
+    }
+
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(writer->fd == -1)
+    {
+        free(writer);
+        return NULL;
+    }
+    writer->format = format;
+
+    //slot i is free for the producer that claims position i
+    for(size_t i = 0; i < STAT_RING_SIZE; ++i)
+    {
+        atomic_init(&writer->slots[i].sequence, i);
+    }
+    atomic_init(&writer->head, 0);
+    atomic_init(&writer->dropped, 0);
+    atomic_init(&writer->running, 1);
+    return writer;
+}
+
+int start_stat_writer(struct stat_writer *writer)
+{
+    if(writer == NULL)
+    {
+        return 0;
+    }
+    if(pthread_create(&writer->thread, NULL, stat_writer_main, writer) != 0)
+    {
+        return -1;
+    }
+    writer->started = 1;
+    return 0;
+}
+
+void record_stat(struct stat_writer *writer, uint32_t seq_num, int64_t elapsed)
+{
+    size_t pos = atomic_load_explicit(&writer->head, memory_order_relaxed);
+    struct stat_slot *slot;
+
+    //claim a slot without a lock, any worker may be recording at the same time
+    for(;;)
+    {
+        slot = &writer->slots[pos & (STAT_RING_SIZE - 1)];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+
+        if(diff == 0)
+        {
+            if(atomic_compare_exchange_weak_explicit(&writer->head, &pos, pos + 1, memory_order_relaxed,
+                                                     memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(diff < 0)
+        {
+            //the writer is a whole ring behind, a lost sample beats stalling the receive path
+            atomic_fetch_add_explicit(&writer->dropped, 1, memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = atomic_load_explicit(&writer->head, memory_order_relaxed);
+        }
+    }
+
+    slot->seq_num = seq_num;
+    slot->elapsed = elapsed;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+static void *stat_writer_main(void *arg)
+{
+    struct stat_writer *writer = (struct stat_writer *) arg;
+    struct timespec idle = {0, STAT_IDLE_NSEC};
+
+    while(atomic_load_explicit(&writer->running, memory_order_acquire))
+    {
+        if(drain_stats(writer) == 0)
+        {
+            nanosleep(&idle, NULL);
+        }
+    }
+
+    //whatever was recorded before the stop
+    while(drain_stats(writer) > 0)
+    {
+    }
+    return NULL;
+}
+
+static size_t drain_stats(struct stat_writer *writer)
+{
+    char buffer[STAT_WRITE_BUF_LEN];
+    size_t len = 0;
+    size_t drained = 0;
+
+    //everything ready goes out in as few writes as the buffer allows
+    for(;;)
+    {
+        struct stat_slot *slot = &writer->slots[writer->tail & (STAT_RING_SIZE - 1)];
+
+        if(atomic_load_explicit(&slot->sequence, memory_order_acquire) != writer->tail + 1)
+        {
+            break;
+        }
+        if(len + 32 > sizeof(buffer))
+        {
+            write_all(writer->fd, buffer, len);
+            len = 0;
+        }
+        len += format_stat(writer, slot, &buffer[len]);
+        //hand the slot back for the producer one lap ahead
+        atomic_store_explicit(&slot->sequence, writer->tail + STAT_RING_SIZE, memory_order_release);
+        writer->tail++;
+        drained++;
+    }
+
+    write_all(writer->fd, buffer, len);
+    return drained;
+}
+
+static size_t format_stat(const struct stat_writer *writer, const struct stat_slot *slot, char *out)
+{
+    if(writer->format == STAT_BINARY)
+    {
+        for(size_t i = 0; i < sizeof(uint32_t); ++i)
+        {
+            out[i] = (char)(slot->seq_num >> (8 * i));
+        }
+        for(size_t i = 0; i < sizeof(int64_t); ++i)
+        {
+            out[sizeof(uint32_t) + i] = (char)((uint64_t)slot->elapsed >> (8 * i));
+        }
+        return STAT_RECORD_LEN;
+    }
+
+    return (size_t)sprintf(out, "%" PRIu32 ", %" PRId64 "\n", slot->seq_num, slot->elapsed);
+}
+
+static void write_all(int fd, const char *buffer, size_t len)
+{
+    while(len > 0)
+    {
+        ssize_t written = write(fd, buffer, len);
+
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("stats write");
+            return;
+        }
+        buffer += written;
+        len -= (size_t)written;
+    }
+}
+
+void close_stat_writer(struct stat_writer *writer)
+{
+    size_t dropped;
+
+    if(writer == NULL)
+    {
+        return;
+    }
+
+    atomic_store_explicit(&writer->running, 0, memory_order_release);
+    if(writer->started)
+    {
+        pthread_join(writer->thread, NULL);
+    }
+    else
+    {
+        while(drain_stats(writer) > 0)
+        {
+        }
+    }
+
+    dropped = atomic_load(&writer->dropped);
+    if(dropped > 0)
+    {
+        printf("Stats: %zu records dropped\n", dropped);
+    }
+    close(writer->fd);
+    free(writer);
+}
@@ -0,0 +1,117 @@
+#include "window.h"
+#include "pool.h"
+
+struct reorder_window *alloc_window(uint32_t win_size, int hold_packets)
+{
+    struct reorder_window *window = calloc(1, sizeof(struct reorder_window));
+    uint32_t slots = 1;
+
+    if(window == NULL)
+    {
+        return NULL;
+    }
+
+    //a window never spans more than the ring, so seq_num & mask never collides inside it
+    while(slots < win_size)
+    {
+        slots <<= 1;
+    }
+    window->mask = slots - 1;
+    window->win_size = win_size;
+    window->slots = hold_packets ? calloc(slots, sizeof(struct stash)) : NULL;
+    window->occupied = calloc((slots + WINDOW_WORD_BITS - 1) / WINDOW_WORD_BITS, sizeof(uint64_t));
+    if((hold_packets && window->slots == NULL) || window->occupied == NULL)
+    {
+        free(window->slots);
+        free(window->occupied);
+        free(window);
+        return NULL;
+    }
+    return window;
+}
+
+void free_window(struct buffer_pool *pool, struct reorder_window *window)
+{
+    for(size_t i = 0; window->slots != NULL && i <= window->mask; ++i)
+    {
+        reset_stash(pool, &window->slots[i]);
+    }
+    free(window->slots);
+    free(window->occupied);
+    free(window);
+}
+
+int window_holds(const struct reorder_window *window, uint32_t seq_num)
+{
+    uint32_t bit = seq_num & window->mask;
+
+    return (int)((window->occupied[bit / WINDOW_WORD_BITS] >> (bit % WINDOW_WORD_BITS)) & 1);
+}
+
+void window_mark(struct reorder_window *window, uint32_t seq_num)
+{
+    uint32_t bit = seq_num & window->mask;
+
+    window->occupied[bit / WINDOW_WORD_BITS] |= (uint64_t)1 << (bit % WINDOW_WORD_BITS);
+    window->held++;
+}
+
+void window_clear_run(struct reorder_window *window, uint32_t seq_num, uint32_t count)
+{
+    window->held -= count;
+
+    //a word at a time, the run may wrap around the end of the ring
+    while(count > 0)
+    {
+        uint32_t bit = seq_num & window->mask;
+        uint32_t shift = bit % WINDOW_WORD_BITS;
+        uint32_t span = WINDOW_WORD_BITS - shift;
+        uint64_t bits;
+
+        if(span > window->mask + 1 - bit)
+        {
+            span = window->mask + 1 - bit;
+        }
+        if(span > count)
+        {
+            span = count;
+        }
+        bits = span == WINDOW_WORD_BITS ? UINT64_MAX : (((uint64_t)1 << span) - 1) << shift;
+        window->occupied[bit / WINDOW_WORD_BITS] &= ~bits;
+        seq_num += span;
+        count -= span;
+    }
+}
+
+uint32_t window_run(const struct reorder_window *window, uint32_t seq_num, uint32_t limit, int held)
+{
+    uint32_t run = 0;
+
+    //count trailing ones (or zeros) a word at a time instead of testing slot by slot
+    while(run < limit)
+    {
+        uint32_t bit = (seq_num + run) & window->mask;
+        uint32_t shift = bit % WINDOW_WORD_BITS;
+        uint32_t span = WINDOW_WORD_BITS - shift;
+        uint64_t word = window->occupied[bit / WINDOW_WORD_BITS] >> shift;
+        uint32_t length;
+
+        if(!held)
+        {
+            word = ~word;
+        }
+        if(span > window->mask + 1 - bit)
+        {
+            span = window->mask + 1 - bit;
+        }
+        length = word == UINT64_MAX ? WINDOW_WORD_BITS : (uint32_t)__builtin_ctzll(~word);
+        if(length < span)
+        {
+            run += length;
+            break;
+        }
+        run += span;
+    }
+
+    return run < limit ? run : limit;
+}
@@ -0,0 +1,218 @@
+#include "workers.h"
+#include "batch.h"
+#include "events.h"
+#include "session.h"
+#include "pool.h"
+#include "sink.h"
+#include "fsm.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <sched.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+static void *worker_main(void *arg);
+static int init_worker(struct server_opts *worker);
+static void release_worker(struct server_opts *worker);
+
+int parse_workers(struct server_opts *opts, const char *arg)
+{
+    char *endptr;
+    uintmax_t parsed_value;
+
+    errno = 0;
+    parsed_value = strtoumax(arg, &endptr, 10);
+
+    if (errno != 0 || *endptr != '\0' || parsed_value == 0 || parsed_value > MAX_WORKERS)
+    {
+        opts->msg = strdup("Worker count must be between 1 and 64.\n");
+        return -1;
+    }
+
+#ifndef __linux__
+    if (parsed_value > 1)
+    {
+        opts->msg = strdup("Worker threads need SO_REUSEPORT load balancing, which needs Linux.\n");
+        return -1;
+    }
+#endif
+
+    opts->workers = (uint32_t)parsed_value;
+    return 0;
+}
+
+void pin_to_core(uint32_t worker_id)
+{
+#ifdef __linux__
+    cpu_set_t cpus;
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(cores < 1)
+    {
+        return;
+    }
+
+    CPU_ZERO(&cpus);
+    CPU_SET(worker_id % (uint32_t)cores, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#else
+    (void)worker_id;
+#endif
+}
+
+static int init_worker(struct server_opts *worker)
+{
+    //shares the configuration and output files, owns its socket, buffer pool, sink, sessions, batches and events
+    worker->msg = NULL;
+    worker->sessions = NULL;
+    worker->pool = NULL;
+    worker->sink = NULL;
+    worker->rx_batch = NULL;
+    worker->ack_batch = NULL;
+    worker->epoll_fd = 0;
+    worker->signal_fd = 0;
+    worker->timer_fd = 0;
+    worker->total_client_seq_num = 0;
+    worker->total_server_seq_num = 0;
+    worker->worker_opts = NULL;
+    worker->threads = NULL;
+
+    if(open_socket(worker) == -1 || init_buffer_pool(worker) == -1 || init_sink(worker) == -1 ||
+       init_sessions(worker) == -1 || init_batches(worker) == -1 || init_events(worker) == -1)
+    {
+        return -1;
+    }
+    worker->timer_deadline = 0;
+    worker->ack_deadline = 0;
+    worker->sweep_deadline = monotonic_usec() + (uint64_t)SESSION_SWEEP_INTERVAL * 1000000;
+    arm_next_timer(worker);
+    return 0;
+}
+
+static void release_worker(struct server_opts *worker)
+{
+    free_batches(worker);
+    close_events(worker);
+    free_sessions(worker);
+    free_sink(worker);
+    free_buffer_pool(worker);
+    if(worker->sock_fd > 0)
+    {
+        close(worker->sock_fd);
+    }
+    if(worker->msg)
+    {
+        free(worker->msg);
+    }
+}
+
+static void *worker_main(void *arg)
+{
+    struct server_opts *worker = (struct server_opts *) arg;
+    int rc;
+
+    pin_to_core(worker->worker_id);
+
+    //the same READ state the main thread runs, for the flows the kernel hashes to this socket
+    while((rc = do_read(worker)) == ok)
+    {
+    }
+
+    if(rc == error)
+    {
+        printf("Worker %u: %s\n", worker->worker_id, worker->msg);
+    }
+    return NULL;
+}
+
+int start_workers(struct server_opts *opts)
+{
+    if(opts->workers <= 1)
+    {
+        return 0;
+    }
+
+#ifdef __linux__
+    //written once at shutdown, it stays readable so every worker wakes up
+    opts->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if(opts->stop_fd == -1)
+    {
+        opts->msg = strdup("eventfd failed\n");
+        return -1;
+    }
+#endif
+
+    opts->worker_opts = calloc(opts->workers, sizeof(struct server_opts));
+    opts->threads = calloc(opts->workers, sizeof(pthread_t));
+    if(opts->worker_opts == NULL || opts->threads == NULL)
+    {
+        opts->msg = strdup("worker allocation failed\n");
+        return -1;
+    }
+
+    //the main thread is worker 0, the rest get their own socket in the same reuseport group
+    for(uint32_t i = 1; i < opts->workers; ++i)
+    {
+        struct server_opts *worker = &opts->worker_opts[i];
+
+        *worker = *opts;
+        worker->worker_id = i;
+        if(init_worker(worker) == -1)
+        {
+            opts->msg = worker->msg ? strdup(worker->msg) : strdup("worker set up failed\n");
+            opts->workers = i + 1;
+            return -1;
+        }
+        if(pthread_create(&opts->threads[i], NULL, worker_main, worker) != 0)
+        {
+            opts->msg = strdup("pthread_create failed\n");
+            opts->workers = i + 1;
+            return -1;
+        }
+    }
+
+    pin_to_core(0);
+    printf("Workers: %u\n", opts->workers);
+    return 0;
+}
+
+void stop_workers(struct server_opts *opts)
+{
+    if(opts->worker_opts == NULL)
+    {
+        return;
+    }
+
+    atomic_store(&exit_flag, true);
+#ifdef __linux__
+    uint64_t stop = 1;
+    if(opts->stop_fd > 0 && write(opts->stop_fd, &stop, sizeof(stop)) != sizeof(stop))
+    {
+        perror("eventfd write");
+    }
+#endif
+
+    for(uint32_t i = 1; i < opts->workers; ++i)
+    {
+        struct server_opts *worker = &opts->worker_opts[i];
+
+        if(opts->threads[i])
+        {
+            pthread_join(opts->threads[i], NULL);
+        }
+        //merge what this worker saw into the totals written by clean_up
+        release_worker(worker);
+        opts->total_client_seq_num += worker->total_client_seq_num;
+        opts->total_server_seq_num += worker->total_server_seq_num;
+    }
+
+    if(opts->stop_fd > 0)
+    {
+        close(opts->stop_fd);
+    }
+    free(opts->worker_opts);
+    free(opts->threads);
+    opts->worker_opts = NULL;
+    opts->threads = NULL;
+}
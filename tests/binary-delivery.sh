@@ -0,0 +1,31 @@
+#!/bin/sh
+# Sends random bytes, NULs included, through the file sink and checks they arrive whole.
+# Usage: tests/binary-delivery.sh <server binary> <client binary> [port]
+
+server=${1:?server binary}
+client=${2:?client binary}
+port=${3:-5701}
+dir=$(mktemp -d)
+trap 'kill "$server_pid" 2>/dev/null; rm -rf "$dir"' EXIT
+
+head -c 300000 /dev/urandom > "$dir/in.bin"
+
+"$server" 127.0.0.1 "$port" -d "$dir/out.bin" > "$dir/server.log" 2>&1 &
+server_pid=$!
+sleep 0.5
+
+(cd "$dir" && timeout 60 "$client" 127.0.0.1 "$port" -f "$dir/in.bin" > "$dir/client.log" 2>&1)
+status=$?
+sleep 0.5
+kill -INT "$server_pid"
+wait "$server_pid"
+
+if [ "$status" -ne 0 ]; then
+    echo "FAIL: client exited with $status"
+    exit 1
+fi
+if ! cmp -s "$dir/in.bin" "$dir/out.bin"; then
+    echo "FAIL: delivered $(wc -c < "$dir/out.bin") of 300000 bytes, or they differ"
+    exit 1
+fi
+echo "PASS: binary payload delivered intact"
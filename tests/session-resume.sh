@@ -0,0 +1,34 @@
+#!/bin/sh
+# Pauses a sender past the server's idle timeout mid-transfer and checks the rest still arrives.
+# Usage: tests/session-resume.sh <server binary> <client binary> [port]
+
+server=${1:?server binary}
+client=${2:?client binary}
+port=${3:-5702}
+pause=40    # past SESSION_IDLE_TIMEOUT and the sweep after it
+dir=$(mktemp -d)
+trap 'kill "$server_pid" 2>/dev/null; rm -rf "$dir"' EXIT
+
+head -c 200000 /dev/urandom > "$dir/in.bin"
+
+"$server" 127.0.0.1 "$port" -d "$dir/out.bin" > "$dir/server.log" 2>&1 &
+server_pid=$!
+sleep 0.5
+
+# the first part goes out and is acked, then the sender goes quiet before the rest
+{ head -c 100000 "$dir/in.bin"; sleep "$pause"; tail -c +100001 "$dir/in.bin"; } |
+    (cd "$dir" && timeout $((pause + 30)) "$client" 127.0.0.1 "$port" > "$dir/client.log" 2>&1)
+status=$?
+sleep 0.5
+kill -INT "$server_pid"
+wait "$server_pid"
+
+if [ "$status" -ne 0 ]; then
+    echo "FAIL: client exited with $status"
+    exit 1
+fi
+if ! cmp -s "$dir/in.bin" "$dir/out.bin"; then
+    echo "FAIL: delivered $(wc -c < "$dir/out.bin") of 200000 bytes, or they differ"
+    exit 1
+fi
+echo "PASS: transfer resumed after the idle timeout"